@@ -0,0 +1,119 @@
+#pragma once
+#ifndef AABB_H
+#define AABB_H
+
+#include "rtweekend.h"
+
+#include <algorithm>
+
+// 光线与轴对齐盒子的无分支slab测试，BVH节点、aabb和box图元共用。
+// 预先算好方向的倒数；每个轴上的近面和远面用min/max选出，不需要比较和交换。
+// dir_is_neg记录方向的符号，遍历BVH时用来决定先访问哪个子节点
+struct slab_ray {
+    real org[3];
+    real inv_dir[3];
+    int dir_is_neg[3];
+
+    slab_ray() {}
+
+    slab_ray(const point3 &origin, const vec3 &direction) {
+        for (int a = 0; a < 3; a++) {
+            org[a] = origin[a];
+            inv_dir[a] = 1 / direction[a];
+            dir_is_neg[a] = inv_dir[a] < 0 ? 1 : 0;
+        }
+    }
+
+    explicit slab_ray(const ray &r) : slab_ray(r.orig, r.dir) {}
+
+    // 盒子的两个角为lo和hi。返回光线在盒内的区间与[t_min, t_max]的交集[t_enter, t_exit]，
+    // t_enter <= t_exit 时击中
+    template<typename T>
+    bool intersect(const T *lo, const T *hi, real t_min, real t_max, real &t_enter, real &t_exit) const {
+        real tx0 = (lo[0] - org[0]) * inv_dir[0], tx1 = (hi[0] - org[0]) * inv_dir[0];
+        real ty0 = (lo[1] - org[1]) * inv_dir[1], ty1 = (hi[1] - org[1]) * inv_dir[1];
+        real tz0 = (lo[2] - org[2]) * inv_dir[2], tz1 = (hi[2] - org[2]) * inv_dir[2];
+        t_enter = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), t_min));
+        t_exit = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::min(std::max(tz0, tz1), t_max));
+        return t_enter <= t_exit;
+    }
+
+    // 包围盒测试：离开的t放大了舍入误差的上界，擦过盒子边缘的光线不会因为舍入被漏掉
+    template<typename T>
+    bool hit(const T *lo, const T *hi, real t_min, real t_max) const {
+        real tx0 = (lo[0] - org[0]) * inv_dir[0], tx1 = (hi[0] - org[0]) * inv_dir[0];
+        real ty0 = (lo[1] - org[1]) * inv_dir[1], ty1 = (hi[1] - org[1]) * inv_dir[1];
+        real tz0 = (lo[2] - org[2]) * inv_dir[2], tz1 = (hi[2] - org[2]) * inv_dir[2];
+        real t_enter = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), t_min));
+        real t_exit = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::max(tz0, tz1));
+        return t_enter <= std::min(t_exit * (1 + 2 * error_gamma(3)), t_max);
+    }
+};
+
+// 轴对齐包围盒 (axis-aligned bounding box)
+class aabb {
+public:
+    // 默认构造一个空盒子，与任何盒子合并都得到那个盒子
+    aabb() : minimum(infinity, infinity, infinity), maximum(-infinity, -infinity, -infinity) {}
+
+    aabb(const point3 &a, const point3 &b) : minimum(a), maximum(b) {}
+
+    point3 min() const { return minimum; }
+
+    point3 max() const { return maximum; }
+
+    bool empty() const {
+        return minimum.x() > maximum.x() || minimum.y() > maximum.y() || minimum.z() > maximum.z();
+    }
+
+    point3 centroid() const { return 0.5 * (minimum + maximum); }
+
+    double surface_area() const {
+        if (empty())
+            return 0;
+        vec3 d = maximum - minimum;
+        return 2.0 * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+    }
+
+    // 最长的轴 0:x 1:y 2:z
+    int longest_axis() const {
+        vec3 d = maximum - minimum;
+        if (d.x() > d.y() && d.x() > d.z())
+            return 0;
+        return d.y() > d.z() ? 1 : 2;
+    }
+
+    // 用比较代替fmin/fmax：包围盒里不会有NaN，比较可以内联成minsd/maxsd，建树时调用非常频繁
+    void expand(const point3 &p) {
+        for (int a = 0; a < 3; a++) {
+            minimum.e[a] = p.e[a] < minimum.e[a] ? p.e[a] : minimum.e[a];
+            maximum.e[a] = p.e[a] > maximum.e[a] ? p.e[a] : maximum.e[a];
+        }
+    }
+
+    void expand(const aabb &box) {
+        for (int a = 0; a < 3; a++) {
+            minimum.e[a] = box.minimum.e[a] < minimum.e[a] ? box.minimum.e[a] : minimum.e[a];
+            maximum.e[a] = box.maximum.e[a] > maximum.e[a] ? box.maximum.e[a] : maximum.e[a];
+        }
+    }
+
+    // slab方法：光线在三个轴上分别进出盒子，三段区间的交集非空则击中
+    bool hit(const ray &r, real t_min, real t_max) const;
+
+public:
+    point3 minimum;
+    point3 maximum;
+};
+
+bool aabb::hit(const ray &r, real t_min, real t_max) const {
+    return slab_ray(r).hit(minimum.e, maximum.e, t_min, t_max);
+}
+
+aabb surrounding_box(const aabb &box0, const aabb &box1) {
+    aabb box = box0;
+    box.expand(box1);
+    return box;
+}
+
+#endif
@@ -0,0 +1,68 @@
+#pragma once
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include "rtweekend.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// 相机关键帧：第frame帧时相机的位置和注视点
+struct camera_keyframe {
+    int frame;
+    point3 lookfrom;
+    point3 lookat;
+};
+
+// Catmull-Rom样条在p1和p2之间的点，t从0到1。曲线经过每个关键帧，并且在关键帧处切线连续
+inline vec3 catmull_rom(const vec3 &p0, const vec3 &p1, const vec3 &p2, const vec3 &p3, double t) {
+    double t2 = t * t, t3 = t2 * t;
+    return 0.5 * (2.0 * p1 + t * (p2 - p0) + t2 * (2.0 * p0 - 5.0 * p1 + 4.0 * p2 - p3) +
+                  t3 * (3.0 * p1 - p0 - 3.0 * p2 + p3));
+}
+
+// 第frame帧的相机，keys按帧号排序。没有关键帧时不修改lookfrom/lookat，
+// 第一个关键帧之前和最后一个关键帧之后相机保持不动
+void interpolate_camera(const std::vector<camera_keyframe> &keys, double frame, point3 &lookfrom, point3 &lookat) {
+    if (keys.empty())
+        return;
+    if (frame <= keys.front().frame) {
+        lookfrom = keys.front().lookfrom;
+        lookat = keys.front().lookat;
+        return;
+    }
+    if (frame >= keys.back().frame) {
+        lookfrom = keys.back().lookfrom;
+        lookat = keys.back().lookat;
+        return;
+    }
+
+    size_t i = 0;
+    while (!(keys[i].frame <= frame && frame < keys[i + 1].frame))
+        ++i;
+    // 两端缺少的控制点用端点本身代替
+    const camera_keyframe &k0 = keys[i > 0 ? i - 1 : i];
+    const camera_keyframe &k1 = keys[i], &k2 = keys[i + 1];
+    const camera_keyframe &k3 = keys[std::min(i + 2, keys.size() - 1)];
+    double t = (frame - k1.frame) / (k2.frame - k1.frame);
+    lookfrom = catmull_rom(k0.lookfrom, k1.lookfrom, k2.lookfrom, k3.lookfrom, t);
+    lookat = catmull_rom(k0.lookat, k1.lookat, k2.lookat, k3.lookat, t);
+}
+
+// 动画每一帧的文件名：在扩展名之前插入4位帧号，image.png的第7帧写到image_0007.png。
+// "-"(标准输出)不变，各帧依次写到同一个流里
+std::string frame_output_path(const std::string &path, int frame) {
+    if (path.empty() || path == "-")
+        return path;
+    std::string number = std::to_string(frame);
+    if (number.size() < 4)
+        number.insert(0, 4 - number.size(), '0');
+    size_t slash = path.find_last_of("/\\");
+    size_t dot = path.rfind('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        dot = path.size();
+    return path.substr(0, dot) + "_" + number + path.substr(dot);
+}
+
+#endif
@@ -0,0 +1,246 @@
+// 基准测试：用固定的场景和设置渲染，报告每秒光线数、每条光线的求交测试数以及
+// 场景构建、渲染、输出三个阶段的耗时，并以JSON写出，方便在不同提交之间比较。
+// 计数器本身会拖慢渲染，所以RayTracingBenchmark和RayTracingBenchmarkFloat不计数，只按采样数和渲染时间
+// 报告吞吐量；RayTracingBenchmarkStats定义RT_STATS，额外报告光线数和每条光线的求交测试数，
+// 它的JSON标记为"instrumented"，其中的时间和每秒光线数包含计数的开销，不能与前两者的吞吐量直接比较。
+// 给出参考图(例如双精度高采样数渲染的PFM)时同时报告图像误差，两种精度可以在速度和误差两方面比较。
+
+#include "rtweekend.h"
+#include "render_job.h"
+#include "rt_stats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// 一个场景的测试结果，渲染重复多次时取最快的一次
+struct benchmark_result {
+    std::string scene;
+    size_t spheres = 0;
+    size_t others = 0;
+    // 实际使用的球体SIMD内核
+    std::string simd;
+    // 参考图，空表示不比较
+    std::string reference;
+    double build_seconds = 0;
+    job_timings timings;
+    // 只在定义RT_STATS时有值
+    ray_counters counters;
+};
+
+void print_usage(const char *program) {
+    std::cerr << "usage: " << program << " [--key value ...]\n"
+              << "  scenes a,b,c (default three_spheres,random,spheres), width W (400), spp N (16),\n"
+              << "  threads N (0 = all cores), repeat N (1), simd scalar|sse2|avx2|avx512, integrator path|wavefront,\n"
+              << "  sampler independent|stratified|sobol|blue-noise,\n"
+              << "  output-dir dir (images are written as bench-<scene>.png, default .),\n"
+              << "  json file (default - for standard output), label text (copied into the JSON),\n"
+              << "  reference a.pfm,b.pfm (one PFM per scene in the same order, empty entries are skipped;\n"
+              << "  the RMSE against it is reported as reference_rmse)\n";
+}
+
+#ifdef RT_STATS
+const bool benchmark_instrumented = true;
+#else
+const bool benchmark_instrumented = false;
+#endif
+
+// JSON字符串，只需要转义引号、反斜杠和控制字符
+std::string json_string(const std::string &text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out += ' ';
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+void write_json(std::ostream &out, const std::string &label, const render_settings &base, int threads,
+                const std::vector<benchmark_result> &results) {
+    out << std::setprecision(6);
+    out << "{\n"
+        << "  \"label\": " << json_string(label) << ",\n"
+        << "  \"real\": \"" << (sizeof(real) == sizeof(float) ? "float" : "double") << "\",\n"
+        << "  \"instrumented\": " << (benchmark_instrumented ? "true" : "false") << ",\n"
+        << "  \"threads\": " << threads << ",\n"
+        << "  \"integrator\": \"" << base.integrator << "\",\n"
+        << "  \"sampler\": \"" << base.sampler << "\",\n"
+        << "  \"width\": " << base.image_width << ",\n"
+        << "  \"height\": " << base.image_height() << ",\n"
+        << "  \"spp\": " << base.samples_per_pixel << ",\n"
+        << "  \"scenes\": [\n";
+    for (size_t k = 0; k < results.size(); ++k) {
+        const benchmark_result &r = results[k];
+        const ray_counters &c = r.counters;
+        double render = r.timings.render_seconds;
+        double rays = static_cast<double>(c.rays);
+        out << "    {\n"
+            << "      \"name\": " << json_string(r.scene) << ",\n"
+            << "      \"spheres\": " << r.spheres << ",\n"
+            << "      \"other_objects\": " << r.others << ",\n"
+            << "      \"simd\": \"" << r.simd << "\",\n"
+            << "      \"build_seconds\": " << r.build_seconds << ",\n"
+            << "      \"render_seconds\": " << render << ",\n"
+            << "      \"output_seconds\": " << r.timings.output_seconds << ",\n"
+            << "      \"samples\": " << r.timings.samples << ",\n";
+        if (!r.reference.empty())
+            out << "      \"reference\": " << json_string(r.reference) << ",\n"
+                << "      \"reference_rmse\": " << r.timings.reference_rmse << ",\n";
+        // 每个采样是一条主光线，不计数也能得到主光线的吞吐量
+        out << "      \"primary_rays_per_second\": " << (render > 0 ? r.timings.samples / render : 0.0);
+        if (benchmark_instrumented) {
+            out << ",\n"
+                << "      \"primary_rays\": " << c.primary_rays() << ",\n"
+                << "      \"rays\": " << c.rays << ",\n"
+                << "      \"rays_per_second\": " << (render > 0 ? rays / render : 0.0) << ",\n"
+                << "      \"node_tests_per_ray\": " << (rays > 0 ? c.node_tests / rays : 0.0) << ",\n"
+                << "      \"primitive_tests_per_ray\": " << (rays > 0 ? c.primitive_tests / rays : 0.0) << ",\n"
+                << "      \"intersection_tests_per_ray\": "
+                << (rays > 0 ? (c.node_tests + c.primitive_tests) / rays : 0.0) << ",\n"
+                << "      \"rays_by_depth\": [";
+            // 去掉末尾为0的深度
+            int depths = ray_stat_depths;
+            while (depths > 1 && c.rays_by_depth[depths - 1] == 0)
+                --depths;
+            for (int d = 0; d < depths; ++d)
+                out << (d > 0 ? ", " : "") << c.rays_by_depth[d];
+            out << "],\n"
+                << "      \"sphere_tests\": " << c.sphere_tests << ",\n"
+                << "      \"sphere_hits\": " << c.sphere_hits << ",\n"
+                << "      \"scatter\": {\"lambertian\": " << c.scatter_lambertian << ", \"metal\": " << c.scatter_metal
+                << ", \"dielectric\": " << c.scatter_dielectric << "},\n"
+                << "      \"path_ends\": {\"max_depth\": " << c.paths_max_depth << ", \"roulette\": "
+                << c.paths_roulette << ", \"absorbed\": " << c.paths_absorbed << "},\n"
+                << "      \"shadow_rays\": " << c.shadow_rays << ",\n"
+                << "      \"shadow_blocked\": " << c.shadow_blocked;
+        }
+        out << "\n    }" << (k + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+int main(int argc, char **argv) {
+    std::string scene_names = "three_spheres,random,spheres";
+    std::string json_path = "-";
+    std::string output_dir = ".";
+    std::string label;
+    std::string reference_names;
+    int repeat = 1;
+    // 默认的测试规模，命令行上可以修改width、spp、threads和simd
+    setting_list overrides = {{"width", "400"}, {"spp", "16"}, {"progress", "0"}};
+    for (int k = 1; k < argc; k += 2) {
+        std::string arg = argv[k];
+        if (k + 1 >= argc || arg.size() <= 2 || arg.compare(0, 2, "--") != 0) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        std::string key = arg.substr(2), value = argv[k + 1];
+        if (key == "scenes") {
+            scene_names = value;
+        } else if (key == "json") {
+            json_path = value;
+        } else if (key == "output-dir") {
+            output_dir = value;
+        } else if (key == "label") {
+            label = value;
+        } else if (key == "reference") {
+            reference_names = value;
+        } else if (key == "repeat") {
+            repeat = std::max(1, std::atoi(value.c_str()));
+        } else if (key == "width" || key == "spp" || key == "threads" || key == "simd" || key == "integrator" ||
+                   key == "sampler") {
+            overrides.emplace_back(key, value);
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<std::string> scenes;
+    std::istringstream names(scene_names);
+    for (std::string name; std::getline(names, name, ',');)
+        if (!name.empty())
+            scenes.push_back(name);
+    std::vector<std::string> references;
+    std::istringstream reference_list(reference_names);
+    for (std::string name; std::getline(reference_list, name, ',');)
+        references.push_back(name);
+    if (references.size() > scenes.size()) {
+        std::cerr << "more references than scenes\n";
+        return 1;
+    }
+    references.resize(scenes.size());
+
+    render_settings base;
+    if (!make_job_settings({&overrides}, base)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    int threads = base.threads;
+    if (threads <= 0) {
+        unsigned hardware_threads = std::thread::hardware_concurrency();
+        threads = hardware_threads > 0 ? static_cast<int>(hardware_threads) : 1;
+    }
+
+    std::vector<benchmark_result> results;
+    for (size_t s = 0; s < scenes.size(); ++s) {
+        const std::string &name = scenes[s];
+        setting_list scene_layer = {{"scene", name}, {"output", output_dir + "/bench-" + name + ".png"}};
+        if (!references[s].empty())
+            scene_layer.emplace_back("reference", references[s]);
+        render_settings settings;
+        if (!make_job_settings({&scene_layer, &overrides}, settings))
+            return 1;
+
+        benchmark_result result;
+        result.scene = name;
+        result.reference = references[s];
+        compiled_scene scene;
+        auto start = std::chrono::steady_clock::now();
+        if (!load_scene(name, scene, settings.simd_isa_or_detected())) {
+            std::cerr << "cannot load scene '" << name << "'\n";
+            return 1;
+        }
+        result.build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.spheres = scene.sphere_count();
+        result.others = scene.others.size();
+        std::cerr << "scene " << name << ": built in " << result.build_seconds << " s\n";
+
+        for (int run = 0; run < repeat; ++run) {
+            stats_take();
+            job_timings timings;
+            if (!render_job(settings, scene, &timings))
+                return 1;
+            if (run == 0 || timings.render_seconds < result.timings.render_seconds) {
+                result.timings = timings;
+                result.counters = stats_take();
+            }
+        }
+        result.simd = simd_isa_name(scene.isa);
+        results.push_back(result);
+    }
+
+    if (json_path == "-") {
+        write_json(std::cout, label, base, threads, results);
+    } else {
+        std::ofstream out(json_path);
+        write_json(out, label, base, threads, results);
+        if (!out) {
+            std::cerr << "failed to write " << json_path << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,140 @@
+#pragma once
+#ifndef BVH_H
+#define BVH_H
+
+#include "rtweekend.h"
+#include "aabb.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// 构建BVH用的划分函数，flat_bvh按它们建树
+
+// 构建BVH时每个图元的信息：包围盒、包围盒中心、在原数组中的下标
+struct bvh_build_item {
+    aabb box;
+    point3 centroid;
+    size_t index;
+};
+
+// 一次划分的结果：[start, mid) 与 [mid, end)，以及按SAH估计的代价
+struct bvh_split {
+    size_t mid;
+    double cost;
+};
+
+// SAH代价中遍历一个节点与求交一个图元的相对开销
+const double bvh_traversal_cost = 1.0;
+const double bvh_intersect_cost = 1.0;
+const int bvh_bin_count = 16;
+
+// 分桶(binned)的SAH划分：在三个轴上把包围盒中心分到bvh_bin_count个桶里，
+// 选出 A_left * N_left + A_right * N_right 最小的位置，并原地划分items[start, end)。
+// 返回的cost与叶子的代价 N * bvh_intersect_cost 可以直接比较。
+bvh_split bvh_sah_split(std::vector<bvh_build_item> &items, size_t start, size_t end, const aabb &bounds) {
+    size_t count = end - start;
+
+    aabb centroid_bounds;
+    for (size_t k = start; k < end; ++k)
+        centroid_bounds.expand(items[k].centroid);
+
+    struct bin {
+        aabb box;
+        size_t count = 0;
+    };
+
+    int best_axis = -1;
+    int best_bin = 0;
+    double best_cost = infinity;
+
+    // 三个轴的分桶在同一次遍历里完成，每个图元只读一次
+    bin axis_bins[3][bvh_bin_count];
+    double axis_lo[3], axis_scale[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        double extent = centroid_bounds.max()[axis] - centroid_bounds.min()[axis];
+        axis_lo[axis] = centroid_bounds.min()[axis];
+        axis_scale[axis] = extent > 0 ? bvh_bin_count / extent : 0.0;
+    }
+    for (size_t k = start; k < end; ++k) {
+        for (int axis = 0; axis < 3; ++axis) {
+            int b = std::min(bvh_bin_count - 1,
+                             static_cast<int>((items[k].centroid[axis] - axis_lo[axis]) * axis_scale[axis]));
+            axis_bins[axis][b].count++;
+            axis_bins[axis][b].box.expand(items[k].box);
+        }
+    }
+
+    for (int axis = 0; axis < 3; ++axis) {
+        if (axis_scale[axis] <= 0)
+            continue;
+        const bin *bins = axis_bins[axis];
+
+        // 从右往左累计，right_area[b]是桶[b, bin_count)的面积
+        double right_area[bvh_bin_count];
+        size_t right_count[bvh_bin_count];
+        aabb right_box;
+        size_t right_n = 0;
+        for (int b = bvh_bin_count - 1; b > 0; --b) {
+            right_box.expand(bins[b].box);
+            right_n += bins[b].count;
+            right_area[b] = right_box.surface_area();
+            right_count[b] = right_n;
+        }
+
+        aabb left_box;
+        size_t left_n = 0;
+        for (int b = 1; b < bvh_bin_count; ++b) {
+            left_box.expand(bins[b - 1].box);
+            left_n += bins[b - 1].count;
+            if (left_n == 0 || right_count[b] == 0)
+                continue;
+            double cost = left_box.surface_area() * left_n + right_area[b] * right_count[b];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_bin = b;
+            }
+        }
+    }
+
+    auto first = items.begin() + static_cast<std::ptrdiff_t>(start);
+    auto last = items.begin() + static_cast<std::ptrdiff_t>(end);
+
+    if (best_axis < 0) {
+        // 所有中心重合，无法按位置划分，只能对半分
+        return {start + count / 2, bvh_traversal_cost + count * bvh_intersect_cost};
+    }
+
+    double lo = centroid_bounds.min()[best_axis];
+    double scale = bvh_bin_count / (centroid_bounds.max()[best_axis] - lo);
+    auto middle = std::partition(first, last, [&](const bvh_build_item &item) {
+        int b = std::min(bvh_bin_count - 1, static_cast<int>((item.centroid[best_axis] - lo) * scale));
+        return b < best_bin;
+    });
+
+    double area = bounds.surface_area();
+    double cost = bvh_traversal_cost + (area > 0 ? best_cost / area : count) * bvh_intersect_cost;
+    return {static_cast<size_t>(middle - items.begin()), cost};
+}
+
+// 按中心在最长轴上的中位数对半划分，子树的深度只与图元数的对数有关。
+// 返回的cost与所有中心重合时相同，图元不超过叶子上限时直接作为叶子
+bvh_split bvh_median_split(std::vector<bvh_build_item> &items, size_t start, size_t end) {
+    size_t count = end - start;
+    aabb centroid_bounds;
+    for (size_t k = start; k < end; ++k)
+        centroid_bounds.expand(items[k].centroid);
+    int axis = centroid_bounds.longest_axis();
+
+    size_t mid = start + count / 2;
+    std::nth_element(items.begin() + static_cast<std::ptrdiff_t>(start),
+                     items.begin() + static_cast<std::ptrdiff_t>(mid),
+                     items.begin() + static_cast<std::ptrdiff_t>(end),
+                     [axis](const bvh_build_item &a, const bvh_build_item &b) {
+                         return a.centroid[axis] < b.centroid[axis];
+                     });
+    return {mid, bvh_traversal_cost + count * bvh_intersect_cost};
+}
+
+#endif
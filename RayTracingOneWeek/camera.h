@@ -3,13 +3,14 @@
 #define CAMERA_H
 
 #include "rtweekend.h"
+#include "sampler.h"
 
 class camera {
 public:
     // vfov : vertical field-of-view in degrees
     camera(point3 lookfrom, point3 lookat, vec3 vup,
            double vfov, double aspect_ratio, double aperture,
-           double focus_dist) {
+           double focus_dist, double time0 = 0, double time1 = 0) {
         double theta = degrees_to_radians(vfov);
         double h = tan(theta / 2);
         double viewport_height = 2.0 * h;
@@ -19,9 +20,10 @@ public:
 //        double viewport_width = aspect_ratio * viewport_height;
         double focal_length = 1.0;
 
-        auto w = unit_vector(lookfrom - lookat);
-        auto u = unit_vector(cross(vup, w));
-        auto v = cross(w, u);
+        // 写入成员u v w：get_ray用u v在镜头平面上偏移光线起点
+        w = unit_vector(lookfrom - lookat);
+        u = unit_vector(cross(vup, w));
+        v = cross(w, u);
 
         origin = lookfrom;
         horizontal =
@@ -35,6 +37,9 @@ public:
         vertical = focus_dist * viewport_height * v;    // new version
         lower_left_corner = origin - horizontal / 2 - vertical / 2 - focus_dist * w;    // new version
         lens_radius = aperture / 2;
+        // 快门在time0打开、time1关闭，关闭的快门(time1 <= time0)不取快门的那一维
+        shutter_open = time0;
+        shutter_close = time1;
 
 //        horizontal = viewport_width * u;
 //        vertical = viewport_height * v;
@@ -51,11 +56,19 @@ public:
 //        return ray(origin, lower_left_corner + s * horizontal + t * vertical - origin);
 //    }
 
-    ray get_ray(double s, double t) const {
-        vec3 rd = lens_radius * random_in_unit_disk();
+    // 镜头上的位置和快门时刻从采样器的镜头维和快门维取
+    ray get_ray(double s, double t, sampler &smp) const {
+        smp.set_dimension(sampler_lens_dimension);
+        vec3 rd = lens_radius * sample_unit_disk(smp.get_2d());
         vec3 offset = u * rd.x() + v * rd.y();
+        double time = shutter_open;
+        if (shutter_close > shutter_open) {
+            smp.set_dimension(sampler_time_dimension);
+            time += (shutter_close - shutter_open) * smp.get_1d();
+        }
 
-        return ray(origin + offset, lower_left_corner + s * horizontal + t * vertical - origin - offset);
+        return ray(origin + offset, lower_left_corner + s * horizontal + t * vertical - origin - offset,
+                   static_cast<real>(time));
     }
 
 private:
@@ -66,6 +79,7 @@ private:
 
     vec3 u, v, w;
     double lens_radius;
+    double shutter_open, shutter_close;
 };
 
 #endif
\ No newline at end of file
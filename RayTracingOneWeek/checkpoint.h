@@ -0,0 +1,121 @@
+#pragma once
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "framebuffer.h"
+#include "image_writer.h"
+#include "sampler.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+// 渐进式渲染的检查点：framebuffer中每个像素的颜色之和、亮度平方和与采样数。
+// 文件格式(主机字节序)：
+//   8字节魔数 "RTCKPT3\n"
+//   uint32 width, uint32 height, uint64 seed, uint32 sampler, uint32 strata
+//   width * height 个 pixel_accum (5个double)，从下到上、从左到右，与tile大小无关
+// 采样器的类型和分层数(即samples_per_pixel)决定了第k个采样用的随机数，继续渲染时必须相同，
+// 否则新旧采样不再属于同一组分层，结果与一次渲染完不同
+const char checkpoint_magic[8] = {'R', 'T', 'C', 'K', 'P', 'T', '3', '\n'};
+
+struct checkpoint_header {
+    char magic[8];
+    uint32_t width;
+    uint32_t height;
+    uint64_t seed;
+    uint32_t sampler;
+    uint32_t strata;
+};
+
+static_assert(sizeof(checkpoint_header) == 32, "checkpoint_header must stay 32 bytes");
+
+// 先写到临时文件再改名，写到一半被杀掉时旧的检查点仍然完好
+bool write_checkpoint(const std::string &path, const framebuffer &film, uint64_t seed, sampler_type sampler,
+                      int strata) {
+    checkpoint_header header;
+    std::memcpy(header.magic, checkpoint_magic, sizeof(header.magic));
+    header.width = static_cast<uint32_t>(film.width());
+    header.height = static_cast<uint32_t>(film.height());
+    header.seed = seed;
+    header.sampler = static_cast<uint32_t>(sampler);
+    header.strata = static_cast<uint32_t>(strata);
+
+    size_t pixel_count = static_cast<size_t>(film.width()) * film.height();
+    std::vector<unsigned char> data(sizeof(header) + pixel_count * sizeof(pixel_accum));
+    std::memcpy(data.data(), &header, sizeof(header));
+    unsigned char *out = data.data() + sizeof(header);
+    for (int y = 0; y < film.height(); ++y)
+        for (int x = 0; x < film.width(); ++x, out += sizeof(pixel_accum))
+            std::memcpy(out, &film.at(x, y), sizeof(pixel_accum));
+
+    std::string temp_path = path + ".tmp";
+    if (!write_file_block(temp_path, data))
+        return false;
+    // POSIX的rename原子地替换已有文件；Windows上rename不会覆盖，用MoveFileEx替换。
+    // 不能先删除旧文件，否则在两步之间被杀掉就没有检查点了
+#ifdef _WIN32
+    bool renamed = MoveFileExA(temp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    bool renamed = std::rename(temp_path.c_str(), path.c_str()) == 0;
+#endif
+    if (!renamed) {
+        std::cerr << "cannot rename " << temp_path << " to " << path << "\n";
+        return false;
+    }
+    return true;
+}
+
+// 读回检查点，尺寸、采样器和分层数必须与这次渲染一致；seed返回检查点使用的随机种子
+bool read_checkpoint(const std::string &path, framebuffer &film, uint64_t &seed, sampler_type sampler, int strata) {
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        std::cerr << "cannot open checkpoint " << path << "\n";
+        return false;
+    }
+
+    checkpoint_header header;
+    bool ok = std::fread(&header, sizeof(header), 1, file) == 1 &&
+              std::memcmp(header.magic, checkpoint_magic, sizeof(header.magic)) == 0;
+    if (!ok) {
+        std::cerr << path << " is not a checkpoint file\n";
+    } else if (header.width != static_cast<uint32_t>(film.width()) ||
+               header.height != static_cast<uint32_t>(film.height())) {
+        std::cerr << "checkpoint " << path << " is " << header.width << "x" << header.height
+                  << ", expected " << film.width() << "x" << film.height() << "\n";
+        ok = false;
+    } else if (header.sampler != static_cast<uint32_t>(sampler) || header.strata != static_cast<uint32_t>(strata)) {
+        std::cerr << "checkpoint " << path << " was rendered with sampler "
+                  << sampler_type_name(static_cast<sampler_type>(header.sampler)) << " and spp " << header.strata
+                  << ", expected " << sampler_type_name(sampler) << " and spp " << strata << "\n";
+        ok = false;
+    } else {
+        size_t pixel_count = static_cast<size_t>(film.width()) * film.height();
+        std::vector<pixel_accum> pixels(pixel_count);
+        ok = std::fread(pixels.data(), sizeof(pixel_accum), pixel_count, file) == pixel_count;
+        if (!ok) {
+            std::cerr << "checkpoint " << path << " is truncated\n";
+        } else {
+            const pixel_accum *in = pixels.data();
+            for (int y = 0; y < film.height(); ++y)
+                for (int x = 0; x < film.width(); ++x)
+                    film.at(x, y) = *in++;
+            seed = header.seed;
+        }
+    }
+
+    std::fclose(file);
+    return ok;
+}
+
+#endif
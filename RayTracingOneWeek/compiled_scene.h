@@ -0,0 +1,490 @@
+#pragma once
+#ifndef COMPILED_SCENE_H
+#define COMPILED_SCENE_H
+
+#include "rtweekend.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "sphere.h"
+#include "moving_sphere.h"
+#include "bvh.h"
+#include "flat_bvh.h"
+#include "sphere_simd.h"
+#include "instance.h"
+#include "material.h"
+#include "lights.h"
+
+#include <cstdint>
+#include <iostream>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// 运动的球：第0秒的中心、每秒移动的距离、半径和材质下标
+struct sphere_motion {
+    point3 center;
+    vec3 velocity;
+    real radius;
+    uint32_t material;
+
+    point3 center_at(real time) const { return center + time * velocity; }
+
+    // 匀速直线运动，两端的位置就包住了整段路径
+    aabb swept_box(real time0, real time1) const {
+        vec3 extent(std::fabs(radius), std::fabs(radius), std::fabs(radius));
+        aabb box(center_at(time0) - extent, center_at(time0) + extent);
+        box.expand(aabb(center_at(time1) - extent, center_at(time1) + extent));
+        return box;
+    }
+};
+
+// 没有击中任何物体的光线看到的颜色：默认是天空的渐变色，只由场景中的光源照明时用固定的颜色(通常是黑色)
+struct scene_background {
+    bool sky = true;
+    color value = color(0, 0, 0);
+
+    color at(const ray &r) const;
+};
+
+color scene_background::at(const ray &r) const {
+    if (!sky)
+        return value;
+    vec3 unit_direction = unit_vector(r.direction());
+    // x y z 映射 r g b
+    double t = 0.5 * (unit_direction.y() + 1.0);
+    return (1.0 - t) * color(1.0, 1.0, 1.0) + t * color(0.5, 0.7, 1.0);
+}
+
+// 渲染用的紧凑场景：球体按SoA存放(中心、半径、材质下标各自一个数组)，
+// 并按展开后的BVH叶子顺序排列；其他类型的物体(box、网格等)放在另一棵展开的BVH里。
+// 由 compile_scene() 从 hittable_list 生成，或者由 load_scene_binary() 直接映射场景文件得到。
+class compiled_scene : public hittable {
+public:
+    compiled_scene() {}
+
+    compiled_scene(compiled_scene &&) = default;
+
+    compiled_scene &operator=(compiled_scene &&) = default;
+
+    virtual bool hit(
+            const ray &r, real t_min, real t_max, hit_record &rec) const override;
+
+    // 依次查询静止的球、运动的球和其他物体，找到任一交点就返回
+    virtual bool occluded(const ray &r, real t_min, real t_max) const override;
+
+    // 最近一次set_time的区间内的包围盒
+    virtual bool bounding_box(aabb &output_box) const override;
+
+    // 区间与最近一次set_time相同时直接用refit之后的包围盒，否则逐个计算运动的球和其他物体
+    virtual bool bounding_box_during(double time0, double time1, aabb &output_box) const override;
+
+    // 一次求交最多ray_packet_size条相干光线(例如同一像素的多个主光线采样)
+    void hit_packet(const ray *rays, int n, real t_min, real t_max, hit_record *recs, bool *hits) const;
+
+    size_t sphere_count() const { return count; }
+
+    // 选择球体求交内核使用的指令集
+    void set_simd(simd_isa isa);
+
+    sphere_soa spheres() const { return {center_x, center_y, center_z, radius}; }
+
+    // 其他物体的最近交点，击中时更新t_max和rec
+    bool hit_others(const ray &r, real t_min, real &t_max, hit_record &rec) const;
+
+    // 运动的球的最近交点，中心按光线的时间计算，击中时更新t_max和rec
+    bool hit_moving(const ray &r, real t_min, real &t_max, hit_record &rec) const;
+
+    // 让运动的球的BVH包住它们在[time, time + shutter]秒内扫过的范围：只refit，不重新建树。
+    // 实例引用的运动的原型同样更新，之后按bounding_box_during refit others_bvh，
+    // 让实例(包括直接包装运动的球的实例)的包围盒跟上。光线的时间应在这个区间内
+    void set_time(double time, double shutter = 0);
+
+    // 自己有运动的球，或者others中有随时间移动的物体
+    virtual bool animated() const override { return !moving.empty() || others_animated; }
+
+    // 从发光的静止球建立光源表，球体数组和材质表确定之后调用
+    void build_lights();
+
+    // 第k个球(叶子顺序)在光源表中的序号，不是光源时为-1
+    int sphere_light(uint32_t k) const { return sphere_lights.empty() ? -1 : sphere_lights[k]; }
+
+    // 打印节点数、每个图元占用的字节数
+    void report(std::ostream &out) const;
+
+public:
+    size_t count = 0;
+    // 末尾多出 sphere_simd_padding 个半径为0的球，供SIMD内核整块读取。
+    // 数组属于owners中的对象，或者直接指向映射的场景文件
+    const real *center_x = nullptr, *center_y = nullptr, *center_z = nullptr;
+    const real *radius = nullptr;
+    const uint32_t *material_index = nullptr;
+    // 材质表，球体通过下标引用，hit_record里保存的就是这里的指针
+    std::vector<const material *> materials;
+    flat_bvh bvh;
+    // 持有上面的数组、材质和映射文件的对象，场景存在期间一直有效
+    std::vector<shared_ptr<const void>> owners;
+
+    simd_isa isa = simd_isa::scalar;
+    sphere_hit_func hit_kernel = sphere_hit_scalar;
+    sphere_packet_func packet_kernel = sphere_packet_scalar;
+
+    // 运动的球与静止的球分开存放，按moving_bvh的叶子顺序排列。
+    // 静止的球和它们的BVH在动画中保持不变，每一帧只refit这棵小树
+    std::vector<sphere_motion> moving;
+    flat_bvh moving_bvh;
+
+    // 不是球体的物体，按others_bvh的叶子顺序排列
+    std::vector<shared_ptr<hittable>> others;
+    flat_bvh others_bvh;
+    // others中的实例引用的、animated()的原型，每个只出现一次
+    std::vector<shared_ptr<compiled_scene>> animated_prototypes;
+    // others中有animated()的物体，set_time时要refit others_bvh
+    bool others_animated = false;
+    // 最近一次set_time的区间
+    double time_begin = 0, time_end = 0;
+
+    light_list lights;
+    // 每个静止球的光源序号，场景中没有光源时为空
+    std::vector<int> sphere_lights;
+    scene_background background;
+};
+
+// 把list(包括嵌套的hittable_list)中的物体编译为compiled_scene，求交使用isa(不超过CPU支持的范围)。
+// 叶子最多容纳AVX-512一次处理的球数，SAH按isa一次处理的球数估计叶子的代价
+compiled_scene compile_scene(const hittable_list &list, simd_isa isa, int max_leaf_size = sphere_simd_max_width);
+
+// 展开嵌套的hittable_list，把静止的球、运动的球和其他物体分开
+void collect_scene_objects(const hittable_list &list, std::vector<const sphere *> &spheres,
+                           std::vector<const moving_sphere *> &moving, std::vector<shared_ptr<hittable>> &others) {
+    for (const auto &object : list.objects) {
+        if (auto child = dynamic_cast<const hittable_list *>(object.get()))
+            collect_scene_objects(*child, spheres, moving, others);
+        else if (auto s = dynamic_cast<const sphere *>(object.get()))
+            spheres.push_back(s);
+        else if (auto m = dynamic_cast<const moving_sphere *>(object.get()))
+            moving.push_back(m);
+        else
+            others.push_back(object);
+    }
+}
+
+compiled_scene compile_scene(const hittable_list &list, simd_isa isa, int max_leaf_size) {
+    compiled_scene scene;
+    isa = std::min(isa, detect_simd_isa());
+
+    std::vector<const sphere *> spheres;
+    std::vector<const moving_sphere *> moving;
+    collect_scene_objects(list, spheres, moving, scene.others);
+
+    std::vector<bvh_build_item> items;
+    items.reserve(spheres.size());
+    for (size_t k = 0; k < spheres.size(); ++k) {
+        aabb box;
+        spheres[k]->bounding_box(box);
+        items.push_back({box, box.centroid(), k});
+    }
+    scene.bvh.build(items, max_leaf_size, simd_isa_width(isa));
+
+    // 相同的材质只保存一次
+    std::unordered_map<const material *, uint32_t> material_ids;
+    auto material_id = [&](const shared_ptr<material> &m) {
+        auto found = material_ids.find(m.get());
+        if (found == material_ids.end()) {
+            found = material_ids.emplace(m.get(), static_cast<uint32_t>(scene.materials.size())).first;
+            scene.materials.push_back(m.get());
+            scene.owners.push_back(m);
+        }
+        return found->second;
+    };
+
+    // 按叶子顺序写入SoA数组(四个数组放在同一块内存里)
+    size_t n = scene.bvh.order.size();
+    size_t stride = n + sphere_simd_padding;
+    auto arrays = make_shared<std::vector<real>>(4 * stride, real(0));
+    auto indices = make_shared<std::vector<uint32_t>>(n);
+    real *center_x = arrays->data(), *center_y = center_x + stride, *center_z = center_y + stride;
+    real *radius = center_z + stride;
+    for (size_t k = 0; k < n; ++k) {
+        const sphere *s = spheres[scene.bvh.order[k]];
+        center_x[k] = s->center.x();
+        center_y[k] = s->center.y();
+        center_z[k] = s->center.z();
+        radius[k] = s->radius;
+        (*indices)[k] = material_id(s->mat_ptr);
+    }
+    scene.count = n;
+    scene.center_x = center_x;
+    scene.center_y = center_y;
+    scene.center_z = center_z;
+    scene.radius = radius;
+    scene.material_index = indices->data();
+    scene.owners.push_back(arrays);
+    scene.owners.push_back(indices);
+
+    if (!moving.empty()) {
+        std::vector<bvh_build_item> moving_items;
+        moving_items.reserve(moving.size());
+        for (size_t k = 0; k < moving.size(); ++k) {
+            aabb box;
+            moving[k]->bounding_box(box);
+            moving_items.push_back({box, box.centroid(), k});
+        }
+        scene.moving_bvh.build(moving_items, 4, 1);
+        for (uint32_t k : scene.moving_bvh.order) {
+            const moving_sphere *m = moving[k];
+            scene.moving.push_back({m->center(0), m->velocity(), m->radius, material_id(m->mat_ptr)});
+        }
+        scene.moving_bvh.order.clear();
+    }
+
+    if (!scene.others.empty()) {
+        std::vector<bvh_build_item> other_items;
+        other_items.reserve(scene.others.size());
+        for (size_t k = 0; k < scene.others.size(); ++k) {
+            aabb box;
+            if (!scene.others[k]->bounding_box(box))
+                std::cerr << "No bounding box in compile_scene.\n";
+            other_items.push_back({box, box.centroid(), k});
+        }
+        scene.others_bvh.build(other_items, 4, 1);
+        std::vector<shared_ptr<hittable>> sorted;
+        sorted.reserve(scene.others.size());
+        for (uint32_t k : scene.others_bvh.order)
+            sorted.push_back(scene.others[k]);
+        scene.others.swap(sorted);
+        scene.others_bvh.order.clear();
+
+        std::unordered_set<const compiled_scene *> seen;
+        for (const auto &object : scene.others) {
+            scene.others_animated = scene.others_animated || object->animated();
+            auto inst = dynamic_cast<const instance *>(object.get());
+            auto prototype = inst ? std::dynamic_pointer_cast<compiled_scene>(inst->prototype) : nullptr;
+            if (prototype && prototype->animated() && seen.insert(prototype.get()).second)
+                scene.animated_prototypes.push_back(prototype);
+        }
+    }
+    if (scene.animated())
+        scene.set_time(0);
+
+    scene.build_lights();
+    scene.set_simd(isa);
+    return scene;
+}
+
+void compiled_scene::build_lights() {
+    lights = light_list();
+    sphere_lights.clear();
+    for (size_t k = 0; k < count; ++k) {
+        auto light = dynamic_cast<const diffuse_light *>(materials[material_index[k]]);
+        if (!light)
+            continue;
+        if (sphere_lights.empty())
+            sphere_lights.assign(count, -1);
+        sphere_lights[k] = static_cast<int>(lights.size());
+        lights.add({point3(center_x[k], center_y[k], center_z[k]), static_cast<real>(std::fabs(radius[k])), light->emit});
+    }
+}
+
+void compiled_scene::set_simd(simd_isa requested) {
+    isa = std::min(requested, detect_simd_isa());
+    hit_kernel = sphere_hit_kernel(isa);
+    packet_kernel = sphere_packet_kernel(isa);
+}
+
+void compiled_scene::set_time(double time, double shutter) {
+    time_begin = time;
+    time_end = time + shutter;
+    auto t0 = static_cast<real>(time_begin), t1 = static_cast<real>(time_end);
+    moving_bvh.refit([&](uint32_t first, uint32_t count) {
+        aabb box;
+        for (uint32_t k = first; k < first + count; ++k)
+            box.expand(moving[k].swept_box(t0, t1));
+        return box;
+    });
+
+    if (!others_animated)
+        return;
+    // 实例的包围盒由原型的包围盒变换得到，原型要先更新，之后查询同一区间时直接用它refit的结果
+    for (const auto &prototype : animated_prototypes)
+        prototype->set_time(time, shutter);
+    others_bvh.refit([&](uint32_t first, uint32_t count) {
+        aabb box;
+        for (uint32_t k = first; k < first + count; ++k) {
+            aabb object_box;
+            if (others[k]->bounding_box_during(time_begin, time_end, object_box))
+                box.expand(object_box);
+        }
+        return box;
+    });
+}
+
+bool compiled_scene::hit_moving(const ray &r, real t_min, real &t_max, hit_record &rec) const {
+    return moving_bvh.traverse(r, t_min, t_max, [&](uint32_t first, uint32_t count, real t_lo, real &t_hi) {
+        bool hit_anything = false;
+        for (uint32_t k = first; k < first + count; ++k) {
+            const sphere_motion &m = moving[k];
+            point3 center = m.center_at(r.time());
+            real root;
+            if (sphere_intersect(r, center, m.radius, t_lo, t_hi, root)) {
+                hit_anything = true;
+                t_hi = root;
+                rec.t = root;
+                sphere_set_hit(r, center, m.radius, rec);
+                rec.mat_ptr = materials[m.material];
+            }
+        }
+        return hit_anything;
+    });
+}
+
+bool compiled_scene::hit(const ray &r, real t_min, real t_max, hit_record &rec) const {
+    // 遍历时只记录最近的球和t，命中信息最后只计算一次
+    const sphere_soa soa = spheres();
+    uint32_t closest = 0;
+    real closest_t = t_max;
+    bool hit_sphere = bvh.traverse(r, t_min, closest_t, [&](uint32_t first, uint32_t count,
+                                                            real t_lo, real &t_hi) {
+        RT_STAT_ADD(primitive_tests, count);
+        RT_STAT_ADD(sphere_tests, count);
+        return hit_kernel(soa, first, count, r, t_lo, t_hi, closest);
+    });
+
+    if (hit_sphere) {
+        point3 center(center_x[closest], center_y[closest], center_z[closest]);
+        rec.t = closest_t;
+        sphere_set_hit(r, center, radius[closest], rec);
+        rec.mat_ptr = materials[material_index[closest]];
+        rec.light = sphere_light(closest);
+    }
+
+    // 更近的运动的球和其他物体覆盖rec，它们都不在光源表中
+    bool hit_moving_sphere = hit_moving(r, t_min, closest_t, rec);
+    bool hit_other = hit_others(r, t_min, closest_t, rec);
+    if (hit_moving_sphere || hit_other)
+        rec.light = -1;
+
+    return hit_sphere || hit_moving_sphere || hit_other;
+}
+
+bool compiled_scene::occluded(const ray &r, real t_min, real t_max) const {
+    const sphere_soa soa = spheres();
+    bool blocked = bvh.occluded(r, t_min, t_max, [&](uint32_t first, uint32_t count, real t_lo, real t_hi) {
+        RT_STAT_ADD(primitive_tests, count);
+        RT_STAT_ADD(sphere_tests, count);
+        // 内核会缩短传入的t_hi，这里用的是副本
+        uint32_t closest;
+        return hit_kernel(soa, first, count, r, t_lo, t_hi, closest);
+    });
+    if (blocked)
+        return true;
+
+    blocked = moving_bvh.occluded(r, t_min, t_max, [&](uint32_t first, uint32_t count, real t_lo, real t_hi) {
+        for (uint32_t k = first; k < first + count; ++k) {
+            const sphere_motion &m = moving[k];
+            real root;
+            if (sphere_intersect(r, m.center_at(r.time()), m.radius, t_lo, t_hi, root))
+                return true;
+        }
+        return false;
+    });
+    if (blocked)
+        return true;
+
+    return others_bvh.occluded(r, t_min, t_max, [&](uint32_t first, uint32_t count, real t_lo, real t_hi) {
+        for (uint32_t k = first; k < first + count; ++k)
+            if (others[k]->occluded(r, t_lo, t_hi))
+                return true;
+        return false;
+    });
+}
+
+bool compiled_scene::hit_others(const ray &r, real t_min, real &t_max, hit_record &rec) const {
+    return others_bvh.traverse(r, t_min, t_max, [&](uint32_t first, uint32_t count, real t_lo, real &t_hi) {
+        bool hit_anything = false;
+        for (uint32_t k = first; k < first + count; ++k)
+            if (others[k]->hit(r, t_lo, t_hi, rec)) {
+                hit_anything = true;
+                t_hi = rec.t;
+            }
+        return hit_anything;
+    });
+}
+
+void compiled_scene::hit_packet(const ray *rays, int n, real t_min, real t_max,
+                                hit_record *recs, bool *hits) const {
+    const sphere_soa soa = spheres();
+    ray_packet packet;
+    packet.set(rays, n, t_max);
+
+    bvh.traverse_packet(packet, t_min, [&](uint32_t first, uint32_t count) {
+        RT_STAT_ADD(primitive_tests, count * packet.count);
+        RT_STAT_ADD(sphere_tests, count * packet.count);
+        for (uint32_t k = first; k < first + count; ++k)
+            packet_kernel(packet, soa, k, t_min);
+    });
+
+    for (int i = 0; i < n; ++i) {
+        const ray &r = rays[i];
+        hits[i] = packet.closest[i] != UINT32_MAX;
+        if (hits[i]) {
+            uint32_t k = packet.closest[i];
+            point3 center(center_x[k], center_y[k], center_z[k]);
+            recs[i].t = packet.t_max[i];
+            sphere_set_hit(r, center, radius[k], recs[i]);
+            recs[i].mat_ptr = materials[material_index[k]];
+            recs[i].light = sphere_light(k);
+        }
+        real t_hi = hits[i] ? packet.t_max[i] : t_max;
+        bool hit_moving_sphere = hit_moving(r, t_min, t_hi, recs[i]);
+        bool hit_other = hit_others(r, t_min, t_hi, recs[i]);
+        if (hit_moving_sphere || hit_other) {
+            hits[i] = true;
+            recs[i].light = -1;
+        }
+    }
+}
+
+bool compiled_scene::bounding_box(aabb &output_box) const {
+    output_box = bvh.bounds();
+    output_box.expand(moving_bvh.bounds());
+    output_box.expand(others_bvh.bounds());
+    return !output_box.empty();
+}
+
+bool compiled_scene::bounding_box_during(double time0, double time1, aabb &output_box) const {
+    if (!animated() || (time0 == time_begin && time1 == time_end))
+        return bounding_box(output_box);
+    auto t0 = static_cast<real>(time0), t1 = static_cast<real>(time1);
+    output_box = bvh.bounds();
+    for (const sphere_motion &m : moving)
+        output_box.expand(m.swept_box(t0, t1));
+    for (const auto &object : others) {
+        aabb object_box;
+        if (object->bounding_box_during(time0, time1, object_box))
+            output_box.expand(object_box);
+    }
+    return !output_box.empty();
+}
+
+void compiled_scene::report(std::ostream &out) const {
+    size_t spheres = sphere_count();
+    size_t node_bytes = (bvh.node_count + moving_bvh.node_count) * sizeof(flat_bvh_node);
+    size_t sphere_bytes = spheres * (4 * sizeof(real) + sizeof(uint32_t)) + moving.size() * sizeof(sphere_motion);
+    size_t primitives = spheres + moving.size();
+    // 实例只算一次它们共享的原型
+    size_t instances = 0;
+    std::unordered_set<const hittable *> prototypes;
+    for (const auto &object : others)
+        if (auto inst = dynamic_cast<const instance *>(object.get())) {
+            ++instances;
+            prototypes.insert(inst->prototype.get());
+        }
+    out << "scene: " << spheres << " spheres, " << moving.size() << " moving spheres, " << materials.size() << " materials, "
+        << others.size() << " other objects (" << instances << " instances of "
+        << prototypes.size() << " prototypes), " << bvh.node_count + moving_bvh.node_count << " bvh nodes ("
+        << node_bytes << " bytes), "
+        << (primitives > 0 ? static_cast<double>(node_bytes + sphere_bytes) / primitives : 0.0)
+        << " bytes/primitive, " << simd_isa_name(isa) << " sphere kernel, " << lights.size() << " lights\n";
+}
+
+#endif
@@ -1,25 +1,80 @@
+#pragma once
 #ifndef CUBE_H
 #define CUBE_H
 
 #include "hittable.h"
 
+// 轴对齐的长方体，可以是任意尺寸；需要旋转时用instance包装。
+// 求交使用与BVH相同的无分支slab测试
 class cube : public hittable {
 public:
     cube() {}
 
-    cube(point3 cen, double length, shared_ptr<material> m) : center(cen), side_length(length), mat_ptr(m) {};
+    // 以cen为中心、边长为length的正方体
+    cube(point3 cen, real length, shared_ptr<material> m)
+            : box_min(cen - vec3(length / 2, length / 2, length / 2)),
+              box_max(cen + vec3(length / 2, length / 2, length / 2)), mat_ptr(m) {};
 
-    virtual bool hit(const ray &r, double t_min, double t_max, hit_record &rec) const override;
+    // 两个相对的角，顺序任意
+    cube(const point3 &p0, const point3 &p1, shared_ptr<material> m)
+            : box_min(fmin(p0.x(), p1.x()), fmin(p0.y(), p1.y()), fmin(p0.z(), p1.z())),
+              box_max(fmax(p0.x(), p1.x()), fmax(p0.y(), p1.y()), fmax(p0.z(), p1.z())), mat_ptr(m) {};
+
+    virtual bool hit(const ray &r, real t_min, real t_max, hit_record &rec) const override;
+
+    virtual bool occluded(const ray &r, real t_min, real t_max) const override;
+
+    virtual bool bounding_box(aabb &output_box) const override;
 
 public:
-    point3 center;
-    double side_length;
+    point3 box_min;
+    point3 box_max;
     shared_ptr<material> mat_ptr;
 };
 
-bool cube::hit(const ray &r, double t_min, double t_max, hit_record &rec) const {
+bool cube::hit(const ray &r, real t_min, real t_max, hit_record &rec) const {
+    RT_STAT_ADD(primitive_tests, 1);
+    // 先求出整条直线在盒内的区间，起点在盒内时进入点在t_min之前，交点是离开点
+    real t_enter, t_exit;
+    if (!slab_ray(r).intersect(box_min.e, box_max.e, -infinity, infinity, t_enter, t_exit))
+        return false;
+    real t = t_enter >= t_min ? t_enter : t_exit;
+    if (t < t_min || t > t_max)
+        return false;
+
+    rec.t = t;
+    rec.p = r.at(t);
+    rec.mat_ptr = mat_ptr.get();
+
+    // 交点所在的面是离交点最近的面，厚度为0的盒子也适用
+    vec3 half = 0.5 * (box_max - box_min);
+    vec3 local = rec.p - 0.5 * (box_min + box_max);
+    real dx = fabs(half.x() - fabs(local.x())), dy = fabs(half.y() - fabs(local.y()));
+    real dz = fabs(half.z() - fabs(local.z()));
+    int axis = dx < dy ? (dx < dz ? 0 : 2) : (dy < dz ? 1 : 2);
+    vec3 outward_normal(0, 0, 0);
+    outward_normal.e[axis] = local[axis] < 0 ? -1 : 1;
+    rec.set_face_normal(r, outward_normal);
+
+    // 撞点放到面上，法线方向上没有误差，其余两个坐标的误差不会造成自相交
+    rec.p.e[axis] = local[axis] < 0 ? box_min[axis] : box_max[axis];
+    rec.error = 0;
+    return true;
+}
+
+// 与hit相同的区间测试，不计算法线和撞点
+bool cube::occluded(const ray &r, real t_min, real t_max) const {
+    RT_STAT_ADD(primitive_tests, 1);
+    real t_enter, t_exit;
+    if (!slab_ray(r).intersect(box_min.e, box_max.e, -infinity, infinity, t_enter, t_exit))
+        return false;
+    real t = t_enter >= t_min ? t_enter : t_exit;
+    return t >= t_min && t <= t_max;
+}
 
+bool cube::bounding_box(aabb &output_box) const {
+    output_box = aabb(box_min, box_max);
     return true;
 }
 
-#endif //CUBE_H
\ No newline at end of file
+#endif //CUBE_H
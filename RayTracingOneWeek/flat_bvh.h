@@ -0,0 +1,421 @@
+#pragma once
+#ifndef FLAT_BVH_H
+#define FLAT_BVH_H
+
+#include "rtweekend.h"
+#include "bvh.h"
+#include "sphere_simd.h"
+#include "rt_stats.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <future>
+#include <vector>
+
+// 32字节的BVH节点，两个节点正好占一条64字节的缓存行
+struct flat_bvh_node {
+    // 包围盒用float保存，构建时向外取整，保证仍然包住图元
+    float bounds_min[3];
+    float bounds_max[3];
+    // 内部节点：第二个子节点的下标(第一个子节点紧跟在父节点后面)
+    // 叶子节点：第一个图元在图元数组中的下标
+    uint32_t offset;
+    // 叶子中图元的个数，0表示内部节点
+    uint16_t count;
+    // 内部节点的划分轴，第一个子节点的中心在该轴上更小
+    uint8_t axis;
+    uint8_t pad;
+};
+
+static_assert(sizeof(flat_bvh_node) == 32, "flat_bvh_node must stay 32 bytes");
+
+// 叶子离根的最大深度，也是遍历栈的大小：每个祖先最多在栈里留下一个兄弟节点。
+// 超过flat_bvh_sah_depth层后改用中位数划分，图元数小于2^32时剩下的层数不超过32
+const int flat_bvh_max_depth = 64;
+const int flat_bvh_sah_depth = flat_bvh_max_depth - 32;
+
+// 按深度优先顺序展开到一段连续数组里的BVH。
+// 叶子引用的图元在 order 中是连续的一段，使用者应按 order 重新排列自己的图元数据，
+// 这样遍历到叶子时访问的是连续内存。
+// 遍历只通过node_data访问节点，节点可以来自build()，也可以来自外部(例如映射的场景文件)。
+class flat_bvh {
+public:
+    flat_bvh() {}
+
+    // 移动vector不改变它的缓冲区，node_data仍然有效；复制会让node_data指向原对象
+    flat_bvh(flat_bvh &&) = default;
+
+    flat_bvh &operator=(flat_bvh &&) = default;
+
+    flat_bvh(const flat_bvh &) = delete;
+
+    flat_bvh &operator=(const flat_bvh &) = delete;
+
+    // 对items建树，叶子中最多max_leaf_size个图元。
+    // 叶子用SIMD一次检测leaf_width个图元时，叶子的代价按 ceil(count / leaf_width) 计算
+    void build(std::vector<bvh_build_item> &items, int max_leaf_size, int leaf_width = 1);
+
+    // 与build()结果相同，上面几层的子树交给threads个线程并行构建
+    void build_parallel(std::vector<bvh_build_item> &items, int max_leaf_size, int leaf_width, int threads);
+
+    // 使用外部的节点数组，调用者保证它在flat_bvh使用期间有效
+    void attach(const flat_bvh_node *data, size_t count);
+
+    // 图元移动之后更新包围盒，树的结构和图元的顺序不变。leaf_bounds(first, count)返回叶子中图元的包围盒。
+    // 只能用于build()生成的节点；图元移动得越远，树的质量越差，但比重新建树快得多
+    template<typename LeafBounds>
+    void refit(LeafBounds &&leaf_bounds);
+
+    bool empty() const { return node_count == 0; }
+
+    aabb bounds() const;
+
+    // leaf_func(first, count, t_min, t_max) 检测叶子中的图元，击中时缩短t_max并返回true
+    template<typename LeafFunc>
+    bool traverse(const ray &r, real t_min, real &t_max, LeafFunc &&leaf_func) const;
+
+    // 任意击中的遍历：leaf_func(first, count, t_min, t_max)在叶子中找到任一交点就返回true，
+    // 遍历随即结束，t_max不会缩短。子节点仍按光线方向排序，靠近起点的遮挡物先被找到
+    template<typename LeafFunc>
+    bool occluded(const ray &r, real t_min, real t_max, LeafFunc &&leaf_func) const;
+
+    // 光线包一起遍历：只要有一条光线击中节点就访问它，leaf_func(first, count)更新p.t_max
+    template<typename LeafFunc>
+    void traverse_packet(ray_packet &p, real t_min, LeafFunc &&leaf_func) const;
+
+private:
+    // 包围盒转换为float时向外取整，保证仍然包住图元
+    static void set_node_bounds(flat_bvh_node &node, const aabb &box);
+
+    static bool plan_node(std::vector<bvh_build_item> &items, size_t start, size_t end,
+                          int max_leaf_size, int leaf_width, int depth, flat_bvh_node &node, size_t ranges[4]);
+
+    void make_leaf(std::vector<bvh_build_item> &items, size_t start, size_t end, flat_bvh_node &node);
+
+    // depth是节点离根的深度
+    void build_recursive(std::vector<bvh_build_item> &items, size_t start, size_t end,
+                         int max_leaf_size, int leaf_width, int depth);
+
+    // 再往下parallel_levels层的子树交给其他线程
+    void build_subtree(std::vector<bvh_build_item> &items, size_t start, size_t end,
+                       int max_leaf_size, int leaf_width, int depth, int parallel_levels);
+
+public:
+    // build()生成的节点
+    std::vector<flat_bvh_node> nodes;
+    // order[k] 是第k个图元在原数组中的下标
+    std::vector<uint32_t> order;
+    // 遍历使用的节点
+    const flat_bvh_node *node_data = nullptr;
+    size_t node_count = 0;
+};
+
+// 光线与节点包围盒的slab测试
+inline bool slab_hit_node(const slab_ray &r, const flat_bvh_node &node, real t_min, real t_max) {
+    return r.hit(node.bounds_min, node.bounds_max, t_min, t_max);
+}
+
+void flat_bvh::build(std::vector<bvh_build_item> &items, int max_leaf_size, int leaf_width) {
+    nodes.clear();
+    order.clear();
+    node_data = nullptr;
+    node_count = 0;
+    if (items.empty())
+        return;
+
+    // 深度优先的节点数最多为 2n - 1
+    nodes.reserve(2 * items.size());
+    order.reserve(items.size());
+    build_recursive(items, 0, items.size(), std::max(1, std::min(max_leaf_size, 65535)), std::max(1, leaf_width), 0);
+    node_data = nodes.data();
+    node_count = nodes.size();
+}
+
+void flat_bvh::attach(const flat_bvh_node *data, size_t count) {
+    nodes.clear();
+    order.clear();
+    node_data = data;
+    node_count = count;
+}
+
+void flat_bvh::set_node_bounds(flat_bvh_node &node, const aabb &box) {
+    for (int a = 0; a < 3; a++) {
+        auto lo = static_cast<float>(box.min()[a]);
+        auto hi = static_cast<float>(box.max()[a]);
+        if (lo > box.min()[a])
+            lo = std::nextafter(lo, -std::numeric_limits<float>::infinity());
+        if (hi < box.max()[a])
+            hi = std::nextafter(hi, std::numeric_limits<float>::infinity());
+        node.bounds_min[a] = lo;
+        node.bounds_max[a] = hi;
+    }
+}
+
+template<typename LeafBounds>
+void flat_bvh::refit(LeafBounds &&leaf_bounds) {
+    if (empty() || node_data != nodes.data())
+        return;
+    // 深度优先顺序中子节点总在父节点之后，倒序处理时子节点已经更新过了
+    for (size_t k = nodes.size(); k-- > 0;) {
+        flat_bvh_node &node = nodes[k];
+        if (node.count > 0) {
+            set_node_bounds(node, leaf_bounds(node.offset, node.count));
+            continue;
+        }
+        const flat_bvh_node &first = nodes[k + 1], &second = nodes[node.offset];
+        for (int a = 0; a < 3; a++) {
+            node.bounds_min[a] = std::min(first.bounds_min[a], second.bounds_min[a]);
+            node.bounds_max[a] = std::max(first.bounds_max[a], second.bounds_max[a]);
+        }
+    }
+}
+
+// 为items[start, end)计算节点的包围盒并决定是否划分。
+// 返回true表示应作为叶子；否则[first_start, first_end)和[second_start, second_end)是两个子节点的范围，
+// 第一个子节点的中心在node.axis上更小。depth达到flat_bvh_sah_depth后按中位数划分，限制树的深度
+bool flat_bvh::plan_node(std::vector<bvh_build_item> &items, size_t start, size_t end,
+                         int max_leaf_size, int leaf_width, int depth, flat_bvh_node &node, size_t ranges[4]) {
+    aabb box;
+    for (size_t k = start; k < end; ++k)
+        box.expand(items[k].box);
+
+    node = flat_bvh_node();
+    set_node_bounds(node, box);
+
+    size_t count = end - start;
+    bvh_split split{start, infinity};
+    if (count > 1)
+        split = depth < flat_bvh_sah_depth ? bvh_sah_split(items, start, end, box)
+                                           : bvh_median_split(items, start, end);
+
+    size_t leaf_blocks = (count + leaf_width - 1) / leaf_width;
+    bool make_leaf = count == 1 ||
+                     (count <= static_cast<size_t>(max_leaf_size) && split.cost >= leaf_blocks * bvh_intersect_cost);
+    if (make_leaf)
+        return true;
+
+    size_t mid = split.mid;
+    aabb left_centroids, right_centroids;
+    for (size_t k = start; k < mid; ++k)
+        left_centroids.expand(items[k].centroid);
+    for (size_t k = mid; k < end; ++k)
+        right_centroids.expand(items[k].centroid);
+    vec3 delta = right_centroids.centroid() - left_centroids.centroid();
+    int axis = fabs(delta.x()) > fabs(delta.y()) ? (fabs(delta.x()) > fabs(delta.z()) ? 0 : 2)
+                                                 : (fabs(delta.y()) > fabs(delta.z()) ? 1 : 2);
+    node.axis = static_cast<uint8_t>(axis);
+
+    // 中心在axis上更小的一半作为第一个子节点
+    bool left_first = delta[axis] >= 0;
+    ranges[0] = left_first ? start : mid;
+    ranges[1] = left_first ? mid : end;
+    ranges[2] = left_first ? mid : start;
+    ranges[3] = left_first ? end : mid;
+    return false;
+}
+
+void flat_bvh::make_leaf(std::vector<bvh_build_item> &items, size_t start, size_t end, flat_bvh_node &node) {
+    node.offset = static_cast<uint32_t>(order.size());
+    node.count = static_cast<uint16_t>(end - start);
+    for (size_t k = start; k < end; ++k)
+        order.push_back(static_cast<uint32_t>(items[k].index));
+}
+
+void flat_bvh::build_recursive(std::vector<bvh_build_item> &items, size_t start, size_t end,
+                               int max_leaf_size, int leaf_width, int depth) {
+    size_t node_index = nodes.size();
+    nodes.emplace_back();
+    size_t ranges[4];
+    if (plan_node(items, start, end, max_leaf_size, leaf_width, depth, nodes[node_index], ranges)) {
+        make_leaf(items, start, end, nodes[node_index]);
+        return;
+    }
+
+    build_recursive(items, ranges[0], ranges[1], max_leaf_size, leaf_width, depth + 1);
+    nodes[node_index].offset = static_cast<uint32_t>(nodes.size());
+    build_recursive(items, ranges[2], ranges[3], max_leaf_size, leaf_width, depth + 1);
+}
+
+void flat_bvh::build_parallel(std::vector<bvh_build_item> &items, int max_leaf_size, int leaf_width, int threads) {
+    nodes.clear();
+    order.clear();
+    node_data = nullptr;
+    node_count = 0;
+    if (items.empty())
+        return;
+
+    // 每个线程大约分到两棵子树，构建时间不均匀时也不容易空闲
+    int parallel_levels = 0;
+    while ((1 << parallel_levels) < 2 * threads)
+        ++parallel_levels;
+
+    nodes.reserve(2 * items.size());
+    order.reserve(items.size());
+    build_subtree(items, 0, items.size(), std::max(1, std::min(max_leaf_size, 65535)), std::max(1, leaf_width), 0,
+                  parallel_levels);
+    node_data = nodes.data();
+    node_count = nodes.size();
+}
+
+void flat_bvh::build_subtree(std::vector<bvh_build_item> &items, size_t start, size_t end,
+                             int max_leaf_size, int leaf_width, int depth, int parallel_levels) {
+    // 图元太少时开线程不划算
+    if (parallel_levels <= 0 || end - start < 4096) {
+        build_recursive(items, start, end, max_leaf_size, leaf_width, depth);
+        return;
+    }
+
+    size_t node_index = nodes.size();
+    nodes.emplace_back();
+    size_t ranges[4];
+    if (plan_node(items, start, end, max_leaf_size, leaf_width, depth, nodes[node_index], ranges)) {
+        make_leaf(items, start, end, nodes[node_index]);
+        return;
+    }
+
+    // 两个子节点的图元范围互不重叠，第二棵子树在另一个线程里建到独立的flat_bvh中
+    flat_bvh second;
+    second.nodes.reserve(2 * (ranges[3] - ranges[2]));
+    second.order.reserve(ranges[3] - ranges[2]);
+    std::future<void> task = std::async(std::launch::async, [&]() {
+        second.build_subtree(items, ranges[2], ranges[3], max_leaf_size, leaf_width, depth + 1, parallel_levels - 1);
+    });
+    build_subtree(items, ranges[0], ranges[1], max_leaf_size, leaf_width, depth + 1, parallel_levels - 1);
+    task.get();
+
+    // 接到第一棵子树后面：内部节点的offset加上节点的起点，叶子的offset加上图元的起点
+    auto node_base = static_cast<uint32_t>(nodes.size());
+    auto order_base = static_cast<uint32_t>(order.size());
+    nodes[node_index].offset = node_base;
+    for (flat_bvh_node node : second.nodes) {
+        node.offset += node.count > 0 ? order_base : node_base;
+        nodes.push_back(node);
+    }
+    order.insert(order.end(), second.order.begin(), second.order.end());
+}
+
+aabb flat_bvh::bounds() const {
+    if (empty())
+        return aabb();
+    const flat_bvh_node &root = node_data[0];
+    return aabb(point3(root.bounds_min[0], root.bounds_min[1], root.bounds_min[2]),
+                point3(root.bounds_max[0], root.bounds_max[1], root.bounds_max[2]));
+}
+
+template<typename LeafFunc>
+bool flat_bvh::traverse(const ray &r, real t_min, real &t_max, LeafFunc &&leaf_func) const {
+    if (empty())
+        return false;
+
+    const slab_ray box_ray(r);
+
+    uint32_t stack[flat_bvh_max_depth];
+    int stack_size = 0;
+    uint32_t current = 0;
+    bool hit_anything = false;
+
+    while (true) {
+        const flat_bvh_node &node = node_data[current];
+        RT_STAT_ADD(node_tests, 1);
+        if (slab_hit_node(box_ray, node, t_min, t_max)) {
+            if (node.count > 0) {
+                if (leaf_func(node.offset, node.count, t_min, t_max))
+                    hit_anything = true;
+                if (stack_size == 0)
+                    break;
+                current = stack[--stack_size];
+            } else {
+                assert(stack_size < flat_bvh_max_depth);
+                // 光线沿划分轴的负方向，先访问第二个子节点
+                bool second_first = box_ray.dir_is_neg[node.axis];
+                stack[stack_size++] = second_first ? current + 1 : node.offset;
+                current = second_first ? node.offset : current + 1;
+            }
+        } else {
+            if (stack_size == 0)
+                break;
+            current = stack[--stack_size];
+        }
+    }
+
+    return hit_anything;
+}
+
+template<typename LeafFunc>
+bool flat_bvh::occluded(const ray &r, real t_min, real t_max, LeafFunc &&leaf_func) const {
+    if (empty())
+        return false;
+
+    const slab_ray box_ray(r);
+
+    uint32_t stack[flat_bvh_max_depth];
+    int stack_size = 0;
+    uint32_t current = 0;
+
+    while (true) {
+        const flat_bvh_node &node = node_data[current];
+        RT_STAT_ADD(node_tests, 1);
+        if (slab_hit_node(box_ray, node, t_min, t_max)) {
+            if (node.count > 0) {
+                if (leaf_func(node.offset, node.count, t_min, t_max))
+                    return true;
+                if (stack_size == 0)
+                    break;
+                current = stack[--stack_size];
+            } else {
+                assert(stack_size < flat_bvh_max_depth);
+                bool second_first = box_ray.dir_is_neg[node.axis];
+                stack[stack_size++] = second_first ? current + 1 : node.offset;
+                current = second_first ? node.offset : current + 1;
+            }
+        } else {
+            if (stack_size == 0)
+                break;
+            current = stack[--stack_size];
+        }
+    }
+
+    return false;
+}
+
+template<typename LeafFunc>
+void flat_bvh::traverse_packet(ray_packet &p, real t_min, LeafFunc &&leaf_func) const {
+    if (empty())
+        return;
+
+    slab_ray box_rays[ray_packet_size];
+    for (int i = 0; i < p.count; ++i)
+        box_rays[i] = slab_ray(point3(p.ox[i], p.oy[i], p.oz[i]), vec3(p.dx[i], p.dy[i], p.dz[i]));
+    // 相干光线的方向大致相同，用第一条光线决定子节点的访问顺序
+    const bool dir_is_neg[3] = {p.dx[0] < 0, p.dy[0] < 0, p.dz[0] < 0};
+
+    uint32_t stack[flat_bvh_max_depth];
+    int stack_size = 0;
+    uint32_t current = 0;
+
+    while (true) {
+        const flat_bvh_node &node = node_data[current];
+        bool any_hit = false;
+        for (int i = 0; i < p.count && !any_hit; ++i) {
+            RT_STAT_ADD(node_tests, 1);
+            any_hit = slab_hit_node(box_rays[i], node, t_min, p.t_max[i]);
+        }
+
+        if (any_hit && node.count == 0) {
+            assert(stack_size < flat_bvh_max_depth);
+            bool second_first = dir_is_neg[node.axis];
+            stack[stack_size++] = second_first ? current + 1 : node.offset;
+            current = second_first ? node.offset : current + 1;
+            continue;
+        }
+
+        if (any_hit)
+            leaf_func(node.offset, node.count);
+        if (stack_size == 0)
+            break;
+        current = stack[--stack_size];
+    }
+}
+
+#endif
@@ -0,0 +1,238 @@
+#pragma once
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "rtweekend.h"
+#include "render_thread.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// 一个像素的累加值：线性颜色之和、亮度的平方和与采样数，平均值在输出时才计算
+struct pixel_accum {
+    double r, g, b;
+    double luminance_sq;
+    double samples;
+
+    void add_sample(const color &c) {
+        r += c.x();
+        g += c.y();
+        b += c.z();
+        double y = luminance(c);
+        luminance_sq += y * y;
+        samples += 1;
+    }
+
+    static double luminance(const color &c) {
+        return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+    }
+
+    color average() const {
+        if (samples <= 0)
+            return color(0, 0, 0);
+        double scale = 1.0 / samples;
+        return color(r * scale, g * scale, b * scale);
+    }
+
+    // 平均亮度的标准误差换算到gamma 2校正之后的显示值上：
+    // d sqrt(m) = dm / (2 sqrt(m))，暗处同样的噪声在屏幕上更明显
+    double display_error() const {
+        if (samples < 2)
+            return infinity;
+        double mean = luminance(color(r, g, b)) / samples;
+        double variance = std::max(0.0, (luminance_sq - mean * mean * samples) / (samples - 1));
+        double standard_error = sqrt(variance / samples);
+        return standard_error / (2 * sqrt(std::max(mean, 1e-4)));
+    }
+};
+
+// framebuffer中一个tile的视图，x/y使用整张图像的坐标
+struct framebuffer_tile {
+    pixel_accum *pixels;
+    int x0, y0, x1, y1;
+    int stride;
+
+    pixel_accum &at(int x, int y) const {
+        return pixels[(y - y0) * stride + (x - x0)];
+    }
+};
+
+// 热力图的配色：t从0到1映射为蓝-绿-红
+inline void heat_color(double t, unsigned char *rgb) {
+    t = clamp(t, 0.0, 1.0);
+    rgb[0] = static_cast<unsigned char>(255.999 * clamp(2 * t - 1, 0.0, 1.0));
+    rgb[1] = static_cast<unsigned char>(255.999 * (1 - fabs(2 * t - 1)));
+    rgb[2] = static_cast<unsigned char>(255.999 * clamp(1 - 2 * t, 0.0, 1.0));
+}
+
+// 渲染结果的累加缓冲区。
+// 内存是一整块，按tile存放：每个tile的像素连续且从64字节边界开始，
+// 不同线程写不同的tile时不会落在同一条缓存行上(false sharing)。
+// 色调映射/量化是单独的一步，累加值本身不被修改，之后可以继续追加采样。
+class framebuffer {
+public:
+    framebuffer(int width, int height, int tile_size);
+
+    int width() const { return image_width; }
+
+    int height() const { return image_height; }
+
+    pixel_accum &at(int x, int y);
+
+    const pixel_accum &at(int x, int y) const;
+
+    // tile必须是按tile_size对齐切分出来的(render_thread就是这样切分的)
+    framebuffer_tile view(const render_tile &tile);
+
+    void clear();
+
+    // 线性的平均颜色，float RGB，从上到下
+    std::vector<float> resolve() const;
+
+    // gamma 2校正并量化为8位RGB，从上到下
+    std::vector<unsigned char> tonemap() const;
+
+    // 每个像素的采样数，0到max_samples映射为蓝-绿-红，从上到下
+    std::vector<unsigned char> sample_heatmap(int max_samples) const;
+
+    double total_samples() const;
+
+    // 累加一个tile的渲染耗时。同一时刻只有一个线程渲染某个tile，不需要加锁
+    void add_tile_time(const render_tile &tile, double seconds) {
+        tile_seconds[tile_index(tile.x0 / tile_size, tile.y0 / tile_size)] += seconds;
+    }
+
+    // 像素(x, y)所在tile的累计渲染耗时
+    double tile_time(int x, int y) const {
+        return tile_seconds[tile_index(x / tile_size, y / tile_size)];
+    }
+
+    const std::vector<double> &tile_times() const { return tile_seconds; }
+
+    // 每个tile的渲染耗时，0到最慢的tile映射为蓝-绿-红，从上到下
+    std::vector<unsigned char> time_heatmap() const;
+
+private:
+    size_t tile_index(int tx, int ty) const {
+        return static_cast<size_t>(ty) * tiles_x + tx;
+    }
+
+    size_t tile_offset(int tx, int ty) const {
+        return tile_index(tx, ty) * tile_pixels;
+    }
+
+private:
+    int image_width, image_height;
+    int tile_size;
+    int tiles_x, tiles_y;
+    // 每个tile占用的像素数，向上取整到使tile的字节数为64的整数倍
+    size_t tile_pixels;
+    std::vector<unsigned char> storage;
+    pixel_accum *pixels;
+    // 每个tile在所有渲染轮次中的耗时之和(秒)
+    std::vector<double> tile_seconds;
+};
+
+framebuffer::framebuffer(int width, int height, int tile_size)
+        : image_width(width), image_height(height), tile_size(tile_size) {
+    const size_t line = 64;
+    tiles_x = (width + tile_size - 1) / tile_size;
+    tiles_y = (height + tile_size - 1) / tile_size;
+    tile_pixels = static_cast<size_t>(tile_size) * tile_size;
+    while (tile_pixels * sizeof(pixel_accum) % line != 0)
+        ++tile_pixels;
+
+    storage.assign(tile_pixels * tiles_x * tiles_y * sizeof(pixel_accum) + line, 0);
+    auto address = reinterpret_cast<uintptr_t>(storage.data());
+    pixels = reinterpret_cast<pixel_accum *>((address + line - 1) / line * line);
+    tile_seconds.assign(static_cast<size_t>(tiles_x) * tiles_y, 0.0);
+}
+
+pixel_accum &framebuffer::at(int x, int y) {
+    int tx = x / tile_size, ty = y / tile_size;
+    return pixels[tile_offset(tx, ty) + (y - ty * tile_size) * tile_size + (x - tx * tile_size)];
+}
+
+const pixel_accum &framebuffer::at(int x, int y) const {
+    return const_cast<framebuffer *>(this)->at(x, y);
+}
+
+framebuffer_tile framebuffer::view(const render_tile &tile) {
+    int tx = tile.x0 / tile_size, ty = tile.y0 / tile_size;
+    return {pixels + tile_offset(tx, ty), tile.x0, tile.y0, tile.x1, tile.y1, tile_size};
+}
+
+void framebuffer::clear() {
+    std::fill(storage.begin(), storage.end(), 0);
+    std::fill(tile_seconds.begin(), tile_seconds.end(), 0.0);
+}
+
+std::vector<float> framebuffer::resolve() const {
+    std::vector<float> out(static_cast<size_t>(image_width) * image_height * 3);
+    for (int row = 0; row < image_height; ++row) {
+        int y = image_height - 1 - row;
+        for (int x = 0; x < image_width; ++x) {
+            color c = at(x, y).average();
+            size_t k = (static_cast<size_t>(row) * image_width + x) * 3;
+            out[k + 0] = static_cast<float>(c.x());
+            out[k + 1] = static_cast<float>(c.y());
+            out[k + 2] = static_cast<float>(c.z());
+        }
+    }
+    return out;
+}
+
+std::vector<unsigned char> framebuffer::tonemap() const {
+    std::vector<unsigned char> out(static_cast<size_t>(image_width) * image_height * 3);
+    for (int row = 0; row < image_height; ++row) {
+        int y = image_height - 1 - row;
+        for (int x = 0; x < image_width; ++x) {
+            const pixel_accum &p = at(x, y);
+            double scale = p.samples > 0 ? 1.0 / p.samples : 0.0;
+            size_t k = (static_cast<size_t>(row) * image_width + x) * 3;
+            // Write the translated [0,255] value of each color component.
+            out[k + 0] = static_cast<unsigned char>(256 * clamp(sqrt(scale * p.r), 0.0, 0.999));
+            out[k + 1] = static_cast<unsigned char>(256 * clamp(sqrt(scale * p.g), 0.0, 0.999));
+            out[k + 2] = static_cast<unsigned char>(256 * clamp(sqrt(scale * p.b), 0.0, 0.999));
+        }
+    }
+    return out;
+}
+
+std::vector<unsigned char> framebuffer::sample_heatmap(int max_samples) const {
+    std::vector<unsigned char> out(static_cast<size_t>(image_width) * image_height * 3);
+    for (int row = 0; row < image_height; ++row) {
+        int y = image_height - 1 - row;
+        for (int x = 0; x < image_width; ++x) {
+            size_t k = (static_cast<size_t>(row) * image_width + x) * 3;
+            heat_color(at(x, y).samples / std::max(1, max_samples), &out[k]);
+        }
+    }
+    return out;
+}
+
+std::vector<unsigned char> framebuffer::time_heatmap() const {
+    double slowest = 0;
+    for (double seconds : tile_seconds)
+        slowest = std::max(slowest, seconds);
+    std::vector<unsigned char> out(static_cast<size_t>(image_width) * image_height * 3);
+    for (int row = 0; row < image_height; ++row) {
+        int y = image_height - 1 - row;
+        for (int x = 0; x < image_width; ++x) {
+            size_t k = (static_cast<size_t>(row) * image_width + x) * 3;
+            heat_color(slowest > 0 ? tile_time(x, y) / slowest : 0.0, &out[k]);
+        }
+    }
+    return out;
+}
+
+double framebuffer::total_samples() const {
+    double total = 0;
+    for (int y = 0; y < image_height; ++y)
+        for (int x = 0; x < image_width; ++x)
+            total += at(x, y).samples;
+    return total;
+}
+
+#endif
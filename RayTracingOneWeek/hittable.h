@@ -4,30 +4,78 @@
 
 #include "ray.h"
 #include "rtweekend.h"
+#include "aabb.h"
+#include "rt_stats.h"
+
+#include <cmath>
 
 class material;
 
 /*该结构体记录“撞点”处的信息：离光线起点的距离t、撞点的坐标向量p、撞点出的法向量normal.*/
-struct hit_record {
-    point3 p;
-    vec3 normal;
-    shared_ptr<material> mat_ptr;
-    double t;
+template<typename T>
+struct hit_record_t {
+    vec3_t<T> p;
+    vec3_t<T> normal;
+    // 不拥有材质，材质由场景持有，生命周期长于渲染过程；用裸指针避免每次击中都修改引用计数
+    const material *mat_ptr = nullptr;
+    T t;
+    // p每个分量的绝对误差上界，由求交的图元根据自己的计算方式给出
+    T error = 0;
     bool front_face;
+    // 击中的是场景光源表中的光源时为它的序号，否则为-1，直接光照与BSDF采样做MIS时使用
+    int light = -1;
 
     // 如果射线和法线的方向相同，则该射线在对象内部，如果射线和法线的方向相反，则该射线在对象之外
 
     // 该决定取决于您是要在几何相交时还是在着色时确定表面的侧面，如果反射与入射反向front_face = true
-    inline void set_face_normal(const ray &r, const vec3 &outward_normal) {
+    inline void set_face_normal(const ray_t<T> &r, const vec3_t<T> &outward_normal) {
         front_face = dot(r.direction(), outward_normal) < 0;
         normal = front_face ? outward_normal : -outward_normal;
     }
+
+    // 从撞点沿direction发出的新光线。起点沿法线移出p的误差范围，再把每个坐标向外舍入一个ULP，
+    // 这样新光线从t = 0开始求交也不会再次击中出发的表面，不需要固定的t_min阈值。
+    // 偏移量随误差缩放，远处的大物体和float精度都适用 (Pharr et al., PBRT 3.9)。
+    // error为0(撞点精确地在面上)时也要舍入，否则起点仍在面上。新光线与入射光线在同一时刻
+    ray_t<T> spawn_ray(const vec3_t<T> &direction, T time) const {
+        vec3_t<T> side = dot(direction, normal) < 0 ? -normal : normal;
+        T d = error * (std::fabs(normal.x()) + std::fabs(normal.y()) + std::fabs(normal.z()));
+        vec3_t<T> origin = p + d * side;
+        for (int a = 0; a < 3; ++a) {
+            if (side[a] > 0)
+                origin[a] = next_float_up(origin[a]);
+            else if (side[a] < 0)
+                origin[a] = next_float_down(origin[a]);
+        }
+        return ray_t<T>(origin, direction, time);
+    }
 };
 
+typedef hit_record_t<real> hit_record;
+
 //hitable这个类表示能够被光线撞上的任何物体。比如，球体
 class hittable {
 public:
-    virtual bool hit(const ray &r, double t_min, double t_max, hit_record &rec) const = 0;
+    // 只有返回true时才修改rec，调用者可以直接把最终结果的rec传进来
+    virtual bool hit(const ray &r, real t_min, real t_max, hit_record &rec) const = 0;
+
+    // 阴影光线的查询：[t_min, t_max]内有没有任何交点。找到一个就可以返回，也不需要撞点的信息，
+    // 默认实现退回到hit，能更快回答的物体应当覆盖它
+    virtual bool occluded(const ray &r, real t_min, real t_max) const {
+        hit_record rec;
+        return hit(r, t_min, t_max, rec);
+    }
+
+    // 物体的包围盒，没有有限包围盒的物体返回false
+    virtual bool bounding_box(aabb &output_box) const = 0;
+
+    // 物体在[time0, time1]秒内扫过的范围，静止的物体就是bounding_box
+    virtual bool bounding_box_during(double time0, double time1, aabb &output_box) const {
+        return bounding_box(output_box);
+    }
+
+    // 物体是否随时间移动。移动的物体所在的BVH在每一帧按bounding_box_during refit
+    virtual bool animated() const { return false; }
 };
 
 #endif
\ No newline at end of file
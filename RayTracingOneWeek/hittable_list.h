@@ -20,23 +20,27 @@ public:
     void add(shared_ptr<hittable> object) { objects.push_back(object); }
 
     virtual bool hit(
-            const ray& r, double t_min, double t_max, hit_record& rec) const override;
+            const ray& r, real t_min, real t_max, hit_record& rec) const override;
+
+    // 任何一个物体挡住光线就返回，不再检测剩下的物体
+    virtual bool occluded(const ray& r, real t_min, real t_max) const override;
+
+    virtual bool bounding_box(aabb& output_box) const override;
 
 public:
     std::vector<shared_ptr<hittable>> objects;
 };
 
 // 遍历objects中所有对象，与当前的射线进行相交检测
-bool hittable_list::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
-    hit_record temp_rec;
+bool hittable_list::hit(const ray& r, real t_min, real t_max, hit_record& rec) const {
     bool hit_anything = false;
     auto closest_so_far = t_max;
 
+    // 物体只在击中时写rec，而且每次击中都比之前的更近，所以不需要临时的hit_record
     for (const auto& object : objects) {
-        if (object->hit(r, t_min, closest_so_far, temp_rec)) {
+        if (object->hit(r, t_min, closest_so_far, rec)) {
             hit_anything = true;
-            closest_so_far = temp_rec.t;
-            rec = temp_rec;
+            closest_so_far = rec.t;
         }
     }
 
@@ -46,4 +50,27 @@ bool hittable_list::hit(const ray& r, double t_min, double t_max, hit_record& re
     return hit_anything;
 }
 
+bool hittable_list::occluded(const ray& r, real t_min, real t_max) const {
+    for (const auto& object : objects) {
+        if (object->occluded(r, t_min, t_max))
+            return true;
+    }
+    return false;
+}
+
+// 所有物体包围盒的并集，只要有一个物体没有包围盒就返回false
+bool hittable_list::bounding_box(aabb& output_box) const {
+    if (objects.empty())
+        return false;
+
+    aabb temp_box;
+    output_box = aabb();
+    for (const auto& object : objects) {
+        if (!object->bounding_box(temp_box))
+            return false;
+        output_box.expand(temp_box);
+    }
+    return true;
+}
+
 #endif
\ No newline at end of file
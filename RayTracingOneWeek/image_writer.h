@@ -0,0 +1,384 @@
+#pragma once
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+// 图像输出：二进制PPM(P6)、PNG(内置的deflate编码器)、浮点PFM。
+// 先在内存里编码成完整的文件内容，再一次fwrite写出，不经过iostream逐像素格式化。
+// rgb为从上到下、从左到右排列的8位RGB；hdr为同样排列的线性float RGB。
+
+// 把整块数据写入文件，path为"-"时写到标准输出
+bool write_file_block(const std::string &path, const std::vector<unsigned char> &data) {
+    FILE *file;
+    if (path == "-") {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        file = stdout;
+    } else {
+        file = std::fopen(path.c_str(), "wb");
+        if (!file) {
+            std::cerr << "cannot open " << path << " for writing\n";
+            return false;
+        }
+    }
+
+    bool ok = std::fwrite(data.data(), 1, data.size(), file) == data.size();
+    ok = (file == stdout ? std::fflush(file) : std::fclose(file)) == 0 && ok;
+    if (!ok)
+        std::cerr << "failed to write " << path << "\n";
+    return ok;
+}
+
+// 二进制PPM，整个文件就是一个短文件头加上原始的RGB字节
+std::vector<unsigned char> encode_ppm(const unsigned char *rgb, int width, int height) {
+    std::string header = "P6\n" + std::to_string(width) + ' ' + std::to_string(height) + "\n255\n";
+    std::vector<unsigned char> out(header.begin(), header.end());
+    out.insert(out.end(), rgb, rgb + static_cast<size_t>(width) * height * 3);
+    return out;
+}
+
+// PFM：浮点RGB，行从下到上存放，负的scale表示小端
+std::vector<unsigned char> encode_pfm(const float *hdr, int width, int height) {
+    std::string header = "PF\n" + std::to_string(width) + ' ' + std::to_string(height) + "\n-1.0\n";
+    std::vector<unsigned char> out(header.begin(), header.end());
+    size_t row_bytes = static_cast<size_t>(width) * 3 * sizeof(float);
+    size_t offset = out.size();
+    out.resize(offset + row_bytes * height);
+    for (int y = 0; y < height; ++y) {
+        const float *row = hdr + static_cast<size_t>(height - 1 - y) * width * 3;
+        unsigned char *dst = out.data() + offset + row_bytes * y;
+        for (int k = 0; k < width * 3; ++k) {
+            uint32_t bits;
+            std::memcpy(&bits, row + k, sizeof(bits));
+            dst[4 * k + 0] = static_cast<unsigned char>(bits);
+            dst[4 * k + 1] = static_cast<unsigned char>(bits >> 8);
+            dst[4 * k + 2] = static_cast<unsigned char>(bits >> 16);
+            dst[4 * k + 3] = static_cast<unsigned char>(bits >> 24);
+        }
+    }
+    return out;
+}
+
+// ---------------------------------------------------------------------------
+// deflate (RFC 1951)：LZ77 + 固定哈夫曼编码
+
+// 按位写出，低位在前
+class deflate_bit_writer {
+public:
+    explicit deflate_bit_writer(std::vector<unsigned char> &out) : out(out) {}
+
+    void put(uint32_t bits, int count) {
+        buffer |= static_cast<uint64_t>(bits) << used;
+        used += count;
+        while (used >= 8) {
+            out.push_back(static_cast<unsigned char>(buffer));
+            buffer >>= 8;
+            used -= 8;
+        }
+    }
+
+    // 哈夫曼码是高位在前的，需要反转后再写
+    void put_code(uint32_t code, int length) {
+        uint32_t reversed = 0;
+        for (int k = 0; k < length; ++k)
+            reversed |= ((code >> k) & 1u) << (length - 1 - k);
+        put(reversed, length);
+    }
+
+    void flush() {
+        if (used > 0)
+            out.push_back(static_cast<unsigned char>(buffer));
+        buffer = 0;
+        used = 0;
+    }
+
+private:
+    std::vector<unsigned char> &out;
+    uint64_t buffer = 0;
+    int used = 0;
+};
+
+// 固定哈夫曼表中的字面量/长度符号
+void deflate_put_literal(deflate_bit_writer &bits, int symbol) {
+    if (symbol < 144)
+        bits.put_code(0x30 + symbol, 8);
+    else if (symbol < 256)
+        bits.put_code(0x190 + symbol - 144, 9);
+    else if (symbol < 280)
+        bits.put_code(symbol - 256, 7);
+    else
+        bits.put_code(0xc0 + symbol - 280, 8);
+}
+
+void deflate_put_match(deflate_bit_writer &bits, int length, int distance) {
+    static const int length_base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const int length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                         3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const int dist_base[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                      257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                      8193, 12289, 16385, 24577};
+    static const int dist_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                       7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+    int l = 28;
+    while (length_base[l] > length)
+        --l;
+    deflate_put_literal(bits, 257 + l);
+    bits.put(static_cast<uint32_t>(length - length_base[l]), length_extra[l]);
+
+    int d = 29;
+    while (dist_base[d] > distance)
+        --d;
+    bits.put_code(static_cast<uint32_t>(d), 5);
+    bits.put(static_cast<uint32_t>(distance - dist_base[d]), dist_extra[d]);
+}
+
+// 贪心的LZ77匹配，用3字节哈希链查找32KB窗口内最长的重复串
+std::vector<unsigned char> deflate_compress(const std::vector<unsigned char> &data) {
+    const int window = 32768;
+    const int hash_bits = 15;
+    const int max_chain = 64;
+    const int min_match = 3;
+    const int max_match = 258;
+
+    std::vector<unsigned char> out;
+    out.reserve(data.size() / 2 + 64);
+    deflate_bit_writer bits(out);
+    // 一个使用固定哈夫曼表的最后一个块
+    bits.put(1, 1);
+    bits.put(1, 2);
+
+    std::vector<int> head(1 << hash_bits, -1);
+    std::vector<int> prev(data.size(), -1);
+    auto hash_at = [&](size_t pos) {
+        uint32_t v = (static_cast<uint32_t>(data[pos]) << 16) | (static_cast<uint32_t>(data[pos + 1]) << 8) |
+                     data[pos + 2];
+        return static_cast<int>((v * 2654435761u) >> (32 - hash_bits));
+    };
+    auto insert = [&](size_t pos) {
+        if (pos + min_match > data.size())
+            return;
+        int h = hash_at(pos);
+        prev[pos] = head[h];
+        head[h] = static_cast<int>(pos);
+    };
+
+    size_t pos = 0;
+    while (pos < data.size()) {
+        int best_length = 0;
+        int best_distance = 0;
+        if (pos + min_match <= data.size()) {
+            int limit = static_cast<int>(std::min<size_t>(max_match, data.size() - pos));
+            int candidate = head[hash_at(pos)];
+            for (int chain = 0; candidate >= 0 && chain < max_chain; ++chain) {
+                int distance = static_cast<int>(pos) - candidate;
+                if (distance > window)
+                    break;
+                int length = 0;
+                while (length < limit && data[candidate + length] == data[pos + length])
+                    ++length;
+                if (length > best_length) {
+                    best_length = length;
+                    best_distance = distance;
+                    if (length == limit)
+                        break;
+                }
+                candidate = prev[candidate];
+            }
+        }
+
+        if (best_length >= min_match) {
+            deflate_put_match(bits, best_length, best_distance);
+            for (int k = 0; k < best_length; ++k)
+                insert(pos + k);
+            pos += best_length;
+        } else {
+            deflate_put_literal(bits, data[pos]);
+            insert(pos);
+            ++pos;
+        }
+    }
+
+    deflate_put_literal(bits, 256);
+    bits.flush();
+    return out;
+}
+
+// ---------------------------------------------------------------------------
+// PNG
+
+std::array<uint32_t, 256> png_make_crc_table() {
+    std::array<uint32_t, 256> table;
+    for (uint32_t n = 0; n < 256; ++n) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; ++k)
+            c = (c & 1u) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        table[n] = c;
+    }
+    return table;
+}
+
+uint32_t png_crc32(const unsigned char *data, size_t length, uint32_t crc = 0) {
+    // 局部静态变量的初始化是线程安全的，动画的帧可能在多个线程里同时编码
+    static const std::array<uint32_t, 256> table = png_make_crc_table();
+
+    crc = ~crc;
+    for (size_t k = 0; k < length; ++k)
+        crc = table[(crc ^ data[k]) & 0xffu] ^ (crc >> 8);
+    return ~crc;
+}
+
+void png_put_u32(std::vector<unsigned char> &out, uint32_t v) {
+    out.push_back(static_cast<unsigned char>(v >> 24));
+    out.push_back(static_cast<unsigned char>(v >> 16));
+    out.push_back(static_cast<unsigned char>(v >> 8));
+    out.push_back(static_cast<unsigned char>(v));
+}
+
+void png_put_chunk(std::vector<unsigned char> &out, const char *type, const std::vector<unsigned char> &payload) {
+    png_put_u32(out, static_cast<uint32_t>(payload.size()));
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), payload.begin(), payload.end());
+    png_put_u32(out, png_crc32(out.data() + start, out.size() - start));
+}
+
+inline int png_paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc)
+        return a;
+    return pb <= pc ? b : c;
+}
+
+std::vector<unsigned char> encode_png(const unsigned char *rgb, int width, int height) {
+    // 每一行选择使残差绝对值之和最小的过滤器
+    size_t stride = static_cast<size_t>(width) * 3;
+    std::vector<unsigned char> filtered;
+    filtered.reserve((stride + 1) * height);
+    std::vector<unsigned char> candidate(stride);
+    std::vector<unsigned char> best(stride);
+    std::vector<unsigned char> zero_row(stride, 0);
+
+    for (int y = 0; y < height; ++y) {
+        const unsigned char *row = rgb + stride * y;
+        const unsigned char *up = y > 0 ? row - stride : zero_row.data();
+        long best_score = -1;
+        int best_filter = 0;
+        for (int filter = 0; filter < 5; ++filter) {
+            long score = 0;
+            for (size_t x = 0; x < stride; ++x) {
+                int a = x >= 3 ? row[x - 3] : 0;
+                int b = up[x];
+                int c = x >= 3 ? up[x - 3] : 0;
+                int predicted = 0;
+                switch (filter) {
+                    case 1: predicted = a; break;
+                    case 2: predicted = b; break;
+                    case 3: predicted = (a + b) / 2; break;
+                    case 4: predicted = png_paeth(a, b, c); break;
+                    default: break;
+                }
+                candidate[x] = static_cast<unsigned char>(row[x] - predicted);
+                score += candidate[x] < 128 ? candidate[x] : 256 - candidate[x];
+            }
+            if (best_score < 0 || score < best_score) {
+                best_score = score;
+                best_filter = filter;
+                best.swap(candidate);
+            }
+        }
+        filtered.push_back(static_cast<unsigned char>(best_filter));
+        filtered.insert(filtered.end(), best.begin(), best.end());
+    }
+
+    // zlib封装：头、deflate数据、adler32
+    std::vector<unsigned char> zlib = {0x78, 0x01};
+    std::vector<unsigned char> deflated = deflate_compress(filtered);
+    zlib.insert(zlib.end(), deflated.begin(), deflated.end());
+    uint32_t s1 = 1, s2 = 0;
+    for (unsigned char byte : filtered) {
+        s1 = (s1 + byte) % 65521u;
+        s2 = (s2 + s1) % 65521u;
+    }
+    png_put_u32(zlib, (s2 << 16) | s1);
+
+    std::vector<unsigned char> out = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    std::vector<unsigned char> ihdr;
+    png_put_u32(ihdr, static_cast<uint32_t>(width));
+    png_put_u32(ihdr, static_cast<uint32_t>(height));
+    // 8位深度，RGB，默认压缩/过滤方式，不隔行
+    ihdr.insert(ihdr.end(), {8, 2, 0, 0, 0});
+    png_put_chunk(out, "IHDR", ihdr);
+    png_put_chunk(out, "IDAT", zlib);
+    png_put_chunk(out, "IEND", {});
+    return out;
+}
+
+// ---------------------------------------------------------------------------
+
+// 根据扩展名选择格式：.png、.pfm，其他(包括"-")为二进制PPM
+bool write_image(const std::string &path, int width, int height,
+                 const unsigned char *rgb, const float *hdr) {
+    auto ends_with = [&](const char *ext) {
+        size_t n = std::strlen(ext);
+        return path.size() >= n && path.compare(path.size() - n, n, ext) == 0;
+    };
+
+    if (ends_with(".png"))
+        return write_file_block(path, encode_png(rgb, width, height));
+    if (ends_with(".pfm"))
+        return write_file_block(path, encode_pfm(hdr, width, height));
+    return write_file_block(path, encode_ppm(rgb, width, height));
+}
+
+
+// 读取本程序写出的PFM(小端RGB)，hdr按从上到下的行排列，用来和参考图比较
+bool read_pfm(const std::string &path, int &width, int &height, std::vector<float> &hdr) {
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        std::cerr << "cannot open " << path << "\n";
+        return false;
+    }
+    char magic[3] = {0};
+    double scale = 0;
+    bool ok = std::fscanf(file, "%2s %d %d %lf", magic, &width, &height, &scale) == 4 &&
+              std::strcmp(magic, "PF") == 0 && width > 0 && height > 0 && scale < 0 &&
+              std::fgetc(file) != EOF;
+    if (ok) {
+        size_t row_floats = static_cast<size_t>(width) * 3;
+        std::vector<unsigned char> row(row_floats * 4);
+        hdr.assign(row_floats * height, 0.0f);
+        for (int y = 0; y < height && ok; ++y) {
+            ok = std::fread(row.data(), 1, row.size(), file) == row.size();
+            float *dst = hdr.data() + static_cast<size_t>(height - 1 - y) * row_floats;
+            for (size_t k = 0; ok && k < row_floats; ++k) {
+                uint32_t bits = static_cast<uint32_t>(row[4 * k]) | static_cast<uint32_t>(row[4 * k + 1]) << 8 |
+                                static_cast<uint32_t>(row[4 * k + 2]) << 16 | static_cast<uint32_t>(row[4 * k + 3]) << 24;
+                std::memcpy(dst + k, &bits, sizeof(bits));
+            }
+        }
+    }
+    std::fclose(file);
+    if (!ok)
+        std::cerr << path << " is not a little-endian RGB PFM file\n";
+    return ok;
+}
+
+#endif
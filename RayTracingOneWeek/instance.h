@@ -0,0 +1,72 @@
+#pragma once
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include "rtweekend.h"
+#include "hittable.h"
+#include "transform.h"
+
+// 实例：把共享的原型(单个物体，或者compile_scene得到的一整棵BVH)放到世界中的某个位置和朝向。
+// 同一个原型可以有任意多个实例，每个实例只保存两个方向的变换和原型的指针，
+// 场景的顶层BVH里放实例，原型内部有自己的BVH，内存只随不同几何体的数量增长。
+//
+// 求交时把光线变换到原型的空间，方向不归一化，所以原型空间里的t就是世界空间里的t。
+// 撞点由原型空间的撞点变换回来，而不是用世界空间里的r.at(t)，误差不随t增长
+class instance : public hittable {
+public:
+    instance() {}
+
+    instance(shared_ptr<hittable> prototype, const affine_transform &to_world)
+            : prototype(prototype), to_world(to_world), to_object(to_world.inverse()) {}
+
+    virtual bool hit(const ray &r, real t_min, real t_max, hit_record &rec) const override;
+
+    virtual bool occluded(const ray &r, real t_min, real t_max) const override;
+
+    virtual bool bounding_box(aabb &output_box) const override;
+
+    virtual bool bounding_box_during(double time0, double time1, aabb &output_box) const override;
+
+    virtual bool animated() const override { return prototype->animated(); }
+
+public:
+    // 不是const：含有运动物体的原型在每一帧由compiled_scene::set_time更新包围盒
+    shared_ptr<hittable> prototype;
+    affine_transform to_world;
+    affine_transform to_object;
+};
+
+bool instance::hit(const ray &r, real t_min, real t_max, hit_record &rec) const {
+    ray local(to_object.point(r.origin()), to_object.vector(r.direction()), r.time());
+    if (!prototype->hit(local, t_min, t_max, rec))
+        return false;
+
+    // 原型空间里的法向量已经朝向光线的反方向，变换不改变它与光线方向点积的符号，front_face不变
+    rec.p = to_world.point(rec.p, rec.error, rec.error);
+    rec.normal = unit_vector(to_object.transposed_vector(rec.normal));
+    return true;
+}
+
+// 原型空间的光线方向没有归一化，t与世界空间相同，区间不需要换算
+bool instance::occluded(const ray &r, real t_min, real t_max) const {
+    ray local(to_object.point(r.origin()), to_object.vector(r.direction()), r.time());
+    return prototype->occluded(local, t_min, t_max);
+}
+
+bool instance::bounding_box(aabb &output_box) const {
+    aabb prototype_box;
+    if (!prototype->bounding_box(prototype_box))
+        return false;
+    output_box = to_world.box(prototype_box);
+    return true;
+}
+
+bool instance::bounding_box_during(double time0, double time1, aabb &output_box) const {
+    aabb prototype_box;
+    if (!prototype->bounding_box_during(time0, time1, prototype_box))
+        return false;
+    output_box = to_world.box(prototype_box);
+    return true;
+}
+
+#endif
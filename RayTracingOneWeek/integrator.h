@@ -0,0 +1,183 @@
+#pragma once
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include "rtweekend.h"
+#include "hittable.h"
+#include "material.h"
+#include "sampler.h"
+#include "lights.h"
+#include "compiled_scene.h"
+
+#include <algorithm>
+
+// 积分器调用材质的方式：具体的材质类型M用限定名调用，没有虚函数开销，可以内联；
+// M为material时通过虚函数调用。path_integrator使用material，wavefront对每个材质队列使用具体的类型
+template<typename M>
+struct material_calls {
+    static const M &get(const hit_record &rec) { return *static_cast<const M *>(rec.mat_ptr); }
+
+    static bool scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered, sampler &smp) {
+        return get(rec).M::scatter(r_in, rec, attenuation, scattered, smp);
+    }
+
+    static color eval(const ray &r_in, const hit_record &rec, const vec3 &direction) {
+        return get(rec).M::eval(r_in, rec, direction);
+    }
+
+    static double pdf(const ray &r_in, const hit_record &rec, const vec3 &direction) {
+        return get(rec).M::scatter_pdf(r_in, rec, direction);
+    }
+};
+
+template<>
+struct material_calls<material> {
+    static bool scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered, sampler &smp) {
+        return rec.mat_ptr->scatter(r_in, rec, attenuation, scattered, smp);
+    }
+
+    static color eval(const ray &r_in, const hit_record &rec, const vec3 &direction) {
+        return rec.mat_ptr->eval(r_in, rec, direction);
+    }
+
+    static double pdf(const ray &r_in, const hit_record &rec, const vec3 &direction) {
+        return rec.mat_ptr->scatter_pdf(r_in, rec, direction);
+    }
+};
+
+// 撞点发出的光。r由BSDF采样得到(bsdf_pdf > 0)并且击中的是光源表中的光源时，
+// 直接光照也可能采到这个方向，按功率启发式加权；主光线和镜面方向没有另一种采样方法，权重为1
+color emitted_light(const compiled_scene &world, const ray &r, const hit_record &rec, double bsdf_pdf) {
+    color emission = rec.mat_ptr->emitted(r, rec);
+    if (bsdf_pdf > 0 && rec.light >= 0)
+        emission *= power_heuristic(bsdf_pdf, world.lights.pdf(rec.light, r.origin()));
+    return emission;
+}
+
+// 直接光照(next-event estimation)：从光源表中采样一个光源上的方向，生成撞点到光源的阴影光线。
+// 阴影光线在shadow_t之前没有被挡住时，路径得到throughput * contribution(已经按MIS加权)。
+// 没有光源、光源在表面背面或材质是镜面时返回false
+template<typename M>
+bool light_sample_ray(const compiled_scene &world, const ray &r_in, const hit_record &rec, sampler &smp, int depth,
+                      ray &shadow, real &shadow_t, color &contribution) {
+    if (world.lights.empty())
+        return false;
+    smp.set_dimension(light_dimension(depth));
+    double u = smp.get_1d();
+    light_sample ls;
+    if (!world.lights.sample(rec.p, u, smp.get_2d(), ls))
+        return false;
+    color f = material_calls<M>::eval(r_in, rec, ls.direction);
+    if (f.near_zero())
+        return false;
+
+    double weight = power_heuristic(ls.pdf, material_calls<M>::pdf(r_in, rec, ls.direction));
+    shadow = rec.spawn_ray(ls.direction, r_in.time());
+    // 距离从移出误差范围之后的起点算起(float构建中大物体上的偏移可达1e-3)，并在光源表面之前停下，
+    // 不把光源自己算作遮挡
+    shadow_t = static_cast<real>(world.lights.distance(ls.light, shadow.origin(), ls.direction) * (1 - 1e-4));
+    contribution = f * ls.emission * (weight / ls.pdf);
+    return true;
+}
+
+// 阴影光线在(0, t_max)内没有击中任何物体
+bool unoccluded(const compiled_scene &world, const ray &shadow, real t_max) {
+    RT_STAT_ADD(shadow_rays, 1);
+    if (world.occluded(shadow, 0, t_max)) {
+        RT_STAT_ADD(shadow_blocked, 1);
+        return false;
+    }
+    return true;
+}
+
+// 迭代的路径追踪：沿路径累乘衰减(throughput)，代替递归的ray_color。
+// 每个漫反射撞点向一个光源发出阴影光线(直接光照)，再按BSDF采样继续弹射，两种方法采到光源时用MIS合并
+class path_integrator {
+public:
+    path_integrator() {}
+
+    path_integrator(int max_depth, int rr_depth) : max_depth(max_depth), rr_depth(rr_depth) {}
+
+    // smp是生成这条光线的采样器，每次弹射从它的bounce_dimension(depth)开始取值
+    color trace(const ray &r, const compiled_scene &world, sampler &smp) const {
+        hit_record rec;
+        RT_STAT_RAYS(0, 1);
+        bool hit = max_depth > 0 && world.hit(r, 0, infinity, rec);
+        return trace_from_hit(r, hit, rec, world, smp);
+    }
+
+    // 第一个撞点已经求出时(例如光线包求交)从这里开始追踪
+    color trace_from_hit(const ray &primary, bool hit, const hit_record &primary_rec, const compiled_scene &world,
+                         sampler &smp) const;
+
+public:
+    // 最多弹射的次数
+    int max_depth = 50;
+    // 从第rr_depth次弹射开始使用俄罗斯轮盘赌提前结束路径，0表示不使用
+    int rr_depth = 5;
+};
+
+color path_integrator::trace_from_hit(const ray &primary, bool hit, const hit_record &primary_rec,
+                                      const compiled_scene &world, sampler &smp) const {
+    // If we've exceeded the ray bounce limit, no more light is gathered.
+    if (max_depth <= 0)
+        return color(0, 0, 0);
+
+    color radiance(0, 0, 0);
+    color throughput(1, 1, 1);
+    ray r = primary;
+    hit_record rec = primary_rec;
+    // 采样出r的BSDF的pdf，主光线和镜面方向为0
+    double bsdf_pdf = 0;
+
+    for (int depth = 1; ; ++depth) {
+        if (!hit)
+            return radiance + throughput * world.background.at(r);
+
+        if (rec.mat_ptr->kind == material_kind::other)
+            radiance += throughput * emitted_light(world, r, rec, bsdf_pdf);
+
+        // 已经到达弹射次数上限，散射出去的光线不会再贡献颜色，不必再计算
+        if (depth >= max_depth) {
+            RT_STAT_ADD(paths_max_depth, 1);
+            return radiance;
+        }
+
+        ray shadow;
+        real shadow_t;
+        color contribution;
+        if (light_sample_ray<material>(world, r, rec, smp, depth, shadow, shadow_t, contribution) &&
+            unoccluded(world, shadow, shadow_t))
+            radiance += throughput * contribution;
+
+        // 几何体的颜色
+        ray scattered;
+        color attenuation;
+        smp.set_dimension(bounce_dimension(depth));
+        if (!rec.mat_ptr->scatter(r, rec, attenuation, scattered, smp)) {
+            RT_STAT_ADD(paths_absorbed, 1);
+            return radiance;
+        }
+        bsdf_pdf = rec.mat_ptr->scatter_pdf(r, rec, scattered.direction());
+        throughput = throughput * attenuation;
+
+        // 俄罗斯轮盘赌：以q的概率结束路径，存活的路径除以(1 - q)补偿，期望值不变
+        if (rr_depth > 0 && depth >= rr_depth) {
+            double max_component = std::max(throughput.x(), std::max(throughput.y(), throughput.z()));
+            double q = std::max(0.05, 1.0 - max_component);
+            smp.set_dimension(roulette_dimension(depth));
+            if (smp.get_1d() < q) {
+                RT_STAT_ADD(paths_roulette, 1);
+                return radiance;
+            }
+            throughput /= 1.0 - q;
+        }
+
+        // 散射光线的起点已经移出了撞点的误差范围(hit_record::spawn_ray)，从t = 0开始求交
+        r = scattered;
+        RT_STAT_RAYS(depth, 1);
+        hit = world.hit(r, 0, infinity, rec);
+    }
+}
+
+#endif
@@ -0,0 +1,129 @@
+#pragma once
+#ifndef LIGHTS_H
+#define LIGHTS_H
+
+#include "rtweekend.h"
+#include "sampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// 光源表：场景中发光的静止球。直接光照时按功率(辐射亮度 x 表面积)的比例选一个光源，
+// 再在从撞点看去这个球所张的圆锥内均匀地采样方向(PBRT 12.5)，小而亮的光源也只需要很少的采样。
+// 其他发光的物体(长方体、网格、运动的球)不在表中，只能被BSDF采样的路径碰到
+
+struct sphere_light {
+    point3 center;
+    real radius;
+    color emission;
+};
+
+// 一次光源采样的结果
+struct light_sample {
+    // 单位向量
+    vec3 direction;
+    // 光源在光源表中的序号
+    int light;
+    color emission;
+    // 立体角上的pdf，已经乘上选中这个光源的概率
+    double pdf;
+};
+
+// 功率启发式(Veach 1997)：pdf为a的采样方法得到的样本的MIS权重，另一种方法对同一方向的pdf为b
+inline double power_heuristic(double a, double b) {
+    double a2 = a * a, b2 = b * b;
+    return a2 + b2 > 0 ? a2 / (a2 + b2) : 0.0;
+}
+
+class light_list {
+public:
+    void add(const sphere_light &light);
+
+    bool empty() const { return lights.empty(); }
+
+    size_t size() const { return lights.size(); }
+
+    // u选择光源，s选择圆锥内的方向。p在光源内部时没有可以采样的方向，返回false
+    bool sample(const point3 &p, double u, sample_2d s, light_sample &out) const;
+
+    // 从p对第k个光源采样时，得到圆锥内任一方向的pdf(立体角)
+    double pdf(int k, const point3 &p) const;
+
+    // 从origin沿direction到第k个光源表面的距离，用double计算。方向来自sample时一定朝向光源，
+    // 擦过球的边缘而算不出交点时取离球心最近的点
+    double distance(int k, const point3 &origin, const vec3 &direction) const;
+
+public:
+    std::vector<sphere_light> lights;
+    // 功率的前缀和，cdf[k + 1] - cdf[k]正比于选中第k个光源的概率
+    std::vector<double> cdf = {0.0};
+
+private:
+    double select_probability(size_t k) const { return (cdf[k + 1] - cdf[k]) / cdf.back(); }
+
+    // 圆锥半角的1 - cos，p在光源内部时返回0。直接用1 - cos在远处的小光源上会丢失全部有效位
+    static double cone_extent(const sphere_light &light, const point3 &p);
+};
+
+void light_list::add(const sphere_light &light) {
+    const color &e = light.emission;
+    double luminance = 0.2126 * e.x() + 0.7152 * e.y() + 0.0722 * e.z();
+    lights.push_back(light);
+    cdf.push_back(cdf.back() + std::max(0.0, luminance) * light.radius * light.radius);
+}
+
+double light_list::cone_extent(const sphere_light &light, const point3 &p) {
+    double d2 = (light.center - p).length_squared();
+    double r2 = static_cast<double>(light.radius) * light.radius;
+    if (d2 <= r2)
+        return 0;
+    double sin2_max = r2 / d2;
+    return sin2_max / (1 + std::sqrt(1 - sin2_max));
+}
+
+bool light_list::sample(const point3 &p, double u, sample_2d s, light_sample &out) const {
+    if (lights.empty() || cdf.back() <= 0)
+        return false;
+    size_t k = std::upper_bound(cdf.begin() + 1, cdf.end(), u * cdf.back()) - (cdf.begin() + 1);
+    k = std::min(k, lights.size() - 1);
+    const sphere_light &light = lights[k];
+    double extent = cone_extent(light, p);
+    if (extent <= 0)
+        return false;
+
+    // 圆锥内均匀分布：1 - cos(theta)在[0, extent]上均匀
+    double one_minus_cos = s.u * extent;
+    double cos_theta = 1 - one_minus_cos;
+    double sin_theta = std::sqrt(std::max(0.0, one_minus_cos * (2 - one_minus_cos)));
+    double phi = 2 * pi * s.v;
+    vec3 axis = light.center - p;
+    double d = axis.length();
+    out.direction = from_local(axis / d, vec3(sin_theta * std::cos(phi), sin_theta * std::sin(phi), cos_theta));
+    out.light = static_cast<int>(k);
+    out.emission = light.emission;
+    out.pdf = select_probability(k) / (2 * pi * extent);
+    return true;
+}
+
+double light_list::distance(int k, const point3 &origin, const vec3 &direction) const {
+    const sphere_light &light = lights[k];
+    double ox = origin.x() - static_cast<double>(light.center.x());
+    double oy = origin.y() - static_cast<double>(light.center.y());
+    double oz = origin.z() - static_cast<double>(light.center.z());
+    double dx = direction.x(), dy = direction.y(), dz = direction.z();
+    double a = dx * dx + dy * dy + dz * dz;
+    double half_b = ox * dx + oy * dy + oz * dz;
+    double c = ox * ox + oy * oy + oz * oz - static_cast<double>(light.radius) * light.radius;
+    double discriminant = half_b * half_b - a * c;
+    return (-half_b - std::sqrt(std::max(0.0, discriminant))) / a;
+}
+
+double light_list::pdf(int k, const point3 &p) const {
+    if (k < 0 || cdf.back() <= 0)
+        return 0;
+    double extent = cone_extent(lights[k], p);
+    return extent > 0 ? select_probability(k) / (2 * pi * extent) : 0.0;
+}
+
+#endif
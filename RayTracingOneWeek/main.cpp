@@ -2,111 +2,124 @@
 #include "vec3.h"
 #include "rtweekend.h"
 
-#include "color.h"
 #include "hittable_list.h"
 #include "sphere.h"
 #include "material.h"
+#include "compiled_scene.h"
+#include "integrator.h"
+#include "image_writer.h"
+#include "framebuffer.h"
+#include "checkpoint.h"
+#include "scenes.h"
+#include "scene_file.h"
+#include "settings.h"
+#include "render_job.h"
 
 #include "camera.h"
+#include "render_thread.h"
 
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
-#include <thread>
-#include <mutex>
-
-// Image
-const double aspect_ratio = 16.0 / 9.0;
-const int image_width = 1600;
-const int image_height = static_cast<int>(image_width / aspect_ratio);
-const int max_depth = 50;
-const int samples_per_pixel = 60;
-
-// World
-hittable_list world;
-
-// Camera
-camera cam;
-
-std::vector<std::vector<color>> color_table(image_height + 1, std::vector<color>(image_width + 1));
-
-// ray recursion
-color ray_color(const ray &r, const hittable &world, int depth) {
-    hit_record rec;
-
-    // If we've exceeded the ray bounce limit, no more light is gathered.
-    if (depth <= 0)
-        return color(0, 0, 0);
-
-    // 几何体的颜色
-    if (world.hit(r, 0.001, infinity, rec)) {
-        ray scattered;
-        color attenuation;
-
-        if (rec.mat_ptr->scatter(r, rec, attenuation, scattered))
-            return attenuation * ray_color(scattered, world, depth - 1);
-        return color(0, 0, 0);
-    }
-
-    // 背景色
-    vec3 unit_direction = unit_vector(r.direction());
-    // x y z 映射 r g b
-    double t = 0.5 * (unit_direction.y() + 1.0);
-    return (1.0 - t) * color(1.0, 1.0, 1.0) + t * color(0.5, 0.7, 1.0);
+#include <map>
+#include <utility>
+
+void print_usage(const char *program) {
+    std::cerr << "usage: " << program << " [--settings file] [--key value ...]\n"
+              << "settings (in a settings file write them as key = value, [job] starts a new job):\n"
+              << "  scene random|three_spheres|boxes|forest|spheres|small_lights|carousel|file.txt|file.rtscene, export-scene file.txt|file.rtscene,\n"
+              << "  lookfrom x,y,z, lookat x,y,z, vup x,y,z, vfov deg,\n"
+              << "  aperture A, focus-dist D, width W, aspect 16/9, spp N, pass-spp N, min-spp N,\n"
+              << "  adaptive error, max-depth N, rr-depth N, integrator path|wavefront,\n"
+              << "  sampler independent|stratified|sobol|blue-noise, seed S, threads N,\n"
+              << "  simd scalar|sse2|avx2|avx512, output (-o) image.ppm|image.png|image.pfm,\n"
+              << "  heatmap image, tile-heatmap image, reference image.pfm, checkpoint file, checkpoint-interval seconds,\n"
+              << "  progress 0|1, resume (no value),\n"
+              << "  frames first-last|N, fps F, keyframe \"frame x,y,z x,y,z\" (repeatable), turntable degrees,\n"
+              << "  time seconds, shutter frames (0.5 = 180 degree shutter)\n";
 }
 
-void scan_calculate_color(int height, int width) {
-    int i = width, j = height;
-    color pixel_color(0, 0, 0);
-    for (int s = 0; s < samples_per_pixel; ++s) {
-        double u = (i + random_double()) / (image_width - 1.0);
-        double v = (j + random_double()) / (image_height - 1.0);
-        ray r = cam.get_ray(u, v);
-        pixel_color += ray_color(r, world, max_depth);
+int main(int argc, char **argv) {
+    // 命令行上的设置覆盖设置文件里的设置，并且对所有job生效
+    std::string settings_path;
+    setting_list overrides;
+    for (int k = 1; k < argc; ++k) {
+        std::string arg = argv[k];
+        if (arg == "--settings" && k + 1 < argc) {
+            settings_path = argv[++k];
+        } else if (arg == "--resume") {
+            overrides.emplace_back("resume", "1");
+        } else if (arg == "-o" && k + 1 < argc) {
+            overrides.emplace_back("output", argv[++k]);
+        } else if (arg.size() > 2 && arg.compare(0, 2, "--") == 0 && k + 1 < argc) {
+            overrides.emplace_back(arg.substr(2), argv[++k]);
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
     }
-//    write_color(std::cout, pixel_color, samples_per_pixel);
-    write_color_table(pixel_color, samples_per_pixel, color_table, j, i);
-}
 
-int main() {
-//    Chapter Listing 55:
-//    shared_ptr<lambertian> material_center = make_shared<lambertian>(color(0.7, 0.3, 0.3));
-//    shared_ptr<metal> material_left = make_shared<metal>(color(0.8, 0.8, 0.8), 0.3);
-
-//    Chapter Listing 59:
-    shared_ptr<lambertian> material_ground = make_shared<lambertian>(color(0.8, 0.8, 0.0));
-    shared_ptr<lambertian> material_center = make_shared<lambertian>(color(0.1, 0.2, 0.5));
-    shared_ptr<dielectric> material_left = make_shared<dielectric>(1.5);
-    shared_ptr<metal> material_right = make_shared<metal>(color(0.8, 0.6, 0.2), 0.0);
-
-//    shared_ptr<lambertian> material_ground = make_shared<lambertian>(color(0.8, 0.8, 0.0));
-//    shared_ptr<dielectric> material_center = make_shared<dielectric>(1.5);
-//    shared_ptr<dielectric> material_left = make_shared<dielectric>(1.5);
-//    shared_ptr<metal> material_right = make_shared<metal>(color(0.8, 0.6, 0.2), 1.0);
-
-//    world.add(make_shared<sphere>(point3(0, 0, -1), 0.5));
-//    world.add(make_shared<sphere>(point3(0, -100.5, -1), 100));
-
-    world.add(make_shared<sphere>(point3(0.0, -100.5, -1.0), 100.0, material_ground));
-    world.add(make_shared<sphere>(point3(0.0, 0.0, -1.0), 0.5, material_center));
-    world.add(make_shared<sphere>(point3(-1.0, 0.0, -1.0), 0.5, material_left));
-    world.add(make_shared<sphere>(point3(-1.0, 0.0, -1.0), -0.4, material_left));
-    world.add(make_shared<sphere>(point3(1.0, 0.0, -1.0), 0.5, material_right));
-
-    // Render
-    std::cout << "P3\n" << image_width << ' ' << image_height << "\n255\n";
-
-    for (int j = image_height - 1; j >= 0; --j) {
-        std::cerr << "\routput remaining: " << j << ' ' << std::flush;
-        for (int i = 0; i < image_width; ++i) {
-            scan_calculate_color(j, i);
+    setting_list common;
+    std::vector<setting_list> job_lists;
+    if (!settings_path.empty() && !read_settings_file(settings_path, common, job_lists))
+        return 1;
+    if (job_lists.empty())
+        job_lists.emplace_back();
+
+    std::vector<render_settings> jobs(job_lists.size());
+    for (size_t k = 0; k < jobs.size(); ++k) {
+        if (!make_job_settings({&common, &job_lists[k], &overrides}, jobs[k])) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        if (jobs[k].resume && jobs[k].checkpoint.empty()) {
+            std::cerr << "resume needs a checkpoint file\n";
+            return 1;
+        }
+        if (jobs[k].animated() && !jobs[k].checkpoint.empty()) {
+            std::cerr << "checkpoints cannot be used with frames\n";
+            return 1;
         }
     }
 
-    for (int j = image_height - 1; j >= 0; --j) {
-        std::cerr << "\routput remaining: " << j << ' ' << std::flush;
-        for (int i = 0; i < image_width; ++i) {
-            out_color_table(std::cout, color_table, j, i);
+    // 每个场景只构建一次，之后使用同一指令集的job直接复用。叶子的宽度随指令集而变，不同的指令集分别构建
+    std::map<std::pair<std::string, simd_isa>, compiled_scene> scenes;
+    int failed = 0;
+    for (size_t k = 0; k < jobs.size(); ++k) {
+        const render_settings &settings = jobs[k];
+        simd_isa isa = settings.simd_isa_or_detected();
+        auto found = scenes.find({settings.scene, isa});
+        if (found == scenes.end()) {
+            auto start = std::chrono::steady_clock::now();
+            found = scenes.emplace(std::make_pair(settings.scene, isa), compiled_scene()).first;
+            if (!load_scene(settings.scene, found->second, isa)) {
+                std::cerr << "cannot load scene '" << settings.scene << "'\n";
+                return 1;
+            }
+            std::cerr << "scene " << settings.scene << ": loaded in "
+                      << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s\n";
+            found->second.report(std::cerr);
+        }
+
+        // 导出场景的job不渲染
+        if (!settings.export_scene.empty()) {
+            if (!export_scene(settings.export_scene, found->second))
+                ++failed;
+            continue;
         }
+
+        if (jobs.size() > 1)
+            std::cerr << "job " << k + 1 << "/" << jobs.size() << ": " << settings.output << "\n";
+        bool rendered = settings.animated() ? render_animation(settings, found->second)
+                                            : render_job(settings, found->second);
+        if (!rendered)
+            ++failed;
+#ifdef RT_STATS
+        print_ray_counters(std::cerr, stats_take());
+#endif
     }
 
     std::cerr << "\nDone.\n";
-}
\ No newline at end of file
+    return failed == 0 ? 0 : 1;
+}
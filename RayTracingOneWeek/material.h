@@ -3,48 +3,82 @@
 
 #include "rtweekend.h"
 #include "hittable.h"
+#include "sampler.h"
 
-struct hit_record;
+// 材质的具体类型。wavefront积分器按它把撞点分到各自的队列，再对每个队列调用非虚的scatter
+enum class material_kind {
+    lambertian, metal, dielectric, other
+};
 
 // 告诉射线如何与表面相互作用
 class material {
 public:
+    explicit material(material_kind kind = material_kind::other) : kind(kind) {}
+
     /**
      * @brief 函数简要说明-测试函数
      * @param r_in              参数1 射线
      * @param rec               参数2 离光线起点的距离t、撞点的坐标向量p、撞点出的法向量normal.
      * @param attenuation       参数3 衰弱后的颜色值
      * @param scattered         参数4 散射射线
+     * @param smp               参数5 采样器，已经定位到这次弹射的第一维
      *
      * @return 返回说明
      */
     virtual bool scatter(
-            const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered
+            const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered, sampler &smp
     ) const = 0;
+
+    // 表面自身发出的光。只有kind为other的材质可以发光，积分器不会对前三种材质调用它
+    virtual color emitted(const ray &r_in, const hit_record &rec) const {
+        return color(0, 0, 0);
+    }
+
+    // BSDF乘以cos：从direction(单位向量)射来的光散射到-r_in方向的比例。
+    // 方向由反射定律决定的镜面材质返回0，这样的撞点不做直接光照
+    virtual color eval(const ray &r_in, const hit_record &rec, const vec3 &direction) const {
+        return color(0, 0, 0);
+    }
+
+    // scatter采样到direction的pdf(立体角)，0表示镜面反射或折射
+    virtual double scatter_pdf(const ray &r_in, const hit_record &rec, const vec3 &direction) const {
+        return 0;
+    }
+
+public:
+    // 不是上面三种的材质为other，只能通过虚函数scatter
+    material_kind kind;
 };
 
 // 兰伯特模型类
 class lambertian : public material {
 public:
-    lambertian(const color &a) : albedo(a) {}
+    lambertian(const color &a) : material(material_kind::lambertian), albedo(a) {}
 
     virtual bool scatter(
-            const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered
+            const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered, sampler &smp
     ) const override {
-        // 散射的向量
-        vec3 scatter_direction = rec.normal + random_unit_vector();
+        RT_STAT_ADD(scatter_lambertian, 1);
+        // 散射的向量：按cos加权采样法线一侧的半球，pdf = cos / pi，BSDF乘cos再除以pdf正好是albedo
+        vec3 scatter_direction = from_local(rec.normal, sample_cosine_hemisphere(smp.get_2d()));
 //        vec3 scatter_direction = rec.normal + random_in_unit_sphere();
 //        vec3 scatter_direction = rec.normal + random_in_hemisphere(rec.normal);
 
-        // Catch degenerate scatter direction
-        if (scatter_direction.near_zero())
-            scatter_direction = rec.normal;
-
-        scattered = ray(rec.p, scatter_direction);
+        scattered = rec.spawn_ray(scatter_direction, r_in.time());
         attenuation = albedo;
         return true;
     }
 
+    color eval(const ray &r_in, const hit_record &rec, const vec3 &direction) const override {
+        double cosine = dot(rec.normal, direction);
+        return cosine > 0 ? albedo * (cosine / pi) : color(0, 0, 0);
+    }
+
+    double scatter_pdf(const ray &r_in, const hit_record &rec, const vec3 &direction) const override {
+        double cosine = dot(rec.normal, unit_vector(direction));
+        return cosine > 0 ? cosine / pi : 0.0;
+    }
+
 public:
     color albedo;
 };
@@ -52,12 +86,15 @@ public:
 // 金属类
 class metal : public material {
 public:
-    metal(const color &a, double f) : albedo(a), fuzz(f < 1 ? f : 1) {}
+    metal(const color &a, double f) : material(material_kind::metal), albedo(a), fuzz(f < 1 ? f : 1) {}
 
-    bool scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered) const override {
+    bool scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered,
+                 sampler &smp) const override {
+        RT_STAT_ADD(scatter_metal, 1);
         vec3 reflected = reflect(unit_vector(r_in.direction()), rec.normal);
 //        scattered = ray(rec.p, reflected);
-        scattered = ray(rec.p, reflected + fuzz * random_in_unit_sphere());
+        sample_2d direction = smp.get_2d();
+        scattered = rec.spawn_ray(reflected + fuzz * sample_in_unit_sphere(direction, smp.get_1d()), r_in.time());
         attenuation = albedo;
         return (dot(scattered.direction(), rec.normal) > 0);
     }
@@ -70,9 +107,11 @@ public:
 // dielectric电介质类
 class dielectric : public material {
 public:
-    dielectric(double index_of_refraction) : ir(index_of_refraction) {}
+    dielectric(double index_of_refraction) : material(material_kind::dielectric), ir(index_of_refraction) {}
 
-    virtual bool scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered) const override {
+    virtual bool scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered,
+                         sampler &smp) const override {
+        RT_STAT_ADD(scatter_dielectric, 1);
         attenuation = color(1.0, 1.0, 1.0);
         double refraction_ratio = rec.front_face ? (1.0 / ir) : ir;
 
@@ -85,7 +124,8 @@ public:
 
         vec3 direction;
 
-        if (refraction_ratio * sin_theta > 1.0 || reflectance(cos_theta, refraction_ratio) > random_double()) {
+        // 全反射时不取值，选择反射还是折射的维度总是这次弹射的第一维
+        if (refraction_ratio * sin_theta > 1.0 || reflectance(cos_theta, refraction_ratio) > smp.get_1d()) {
             // Must Reflect
             direction = reflect(unit_direction, rec.normal);
         } else {
@@ -96,7 +136,7 @@ public:
         // old
 //        scattered = ray(rec.p, refracted);
         // new
-        scattered = ray(rec.p, direction);
+        scattered = rec.spawn_ray(direction, r_in.time());
         return true;
     }
 
@@ -112,4 +152,22 @@ private:
     }
 };
 
+// 发光材质：两面都发出emit，不散射光线。发光的静止球会加入场景的光源表
+class diffuse_light : public material {
+public:
+    diffuse_light(const color &c) : emit(c) {}
+
+    bool scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered,
+                 sampler &smp) const override {
+        return false;
+    }
+
+    color emitted(const ray &r_in, const hit_record &rec) const override {
+        return emit;
+    }
+
+public:
+    color emit;
+};
+
 #endif
\ No newline at end of file
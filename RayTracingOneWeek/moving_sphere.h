@@ -0,0 +1,76 @@
+#pragma once
+#ifndef MOVING_SPHERE_H
+#define MOVING_SPHERE_H
+
+#include "hittable.h"
+#include "sphere.h"
+#include "vec3.h"
+
+// 运动的球：time0时中心在center0，time1时在center1，其他时刻按时间线性插值(区间之外沿同一方向外推)。
+// 求交时使用光线那一时刻的中心，快门期间的采样合起来就是运动模糊，不需要渲染多帧再平均
+class moving_sphere : public hittable {
+public:
+    moving_sphere() {}
+
+    moving_sphere(point3 cen0, point3 cen1, double time0, double time1, real r, shared_ptr<material> m)
+            : center0(cen0), center1(cen1), time0(time0), time1(time1), radius(r), mat_ptr(m) {};
+
+    virtual bool hit(
+            const ray &r, real t_min, real t_max, hit_record &rec) const override;
+
+    virtual bool occluded(const ray &r, real t_min, real t_max) const override;
+
+    // 只包住球在time0到time1之间扫过的范围。center()在这段时间之外继续外推，
+    // 其他时刻的光线要用bounding_box_during的包围盒，否则会被错误地剔除
+    virtual bool bounding_box(aabb &output_box) const override;
+
+    virtual bool bounding_box_during(double t0, double t1, aabb &output_box) const override;
+
+    virtual bool animated() const override { return true; }
+
+    point3 center(double time) const {
+        return center0 + static_cast<real>(time - time0) * velocity();
+    }
+
+    // 每秒移动的距离
+    vec3 velocity() const {
+        return time1 > time0 ? (center1 - center0) / static_cast<real>(time1 - time0) : vec3(0, 0, 0);
+    }
+
+public:
+    point3 center0, center1;
+    double time0, time1;
+    real radius;
+    shared_ptr<material> mat_ptr;
+};
+
+bool moving_sphere::hit(const ray &r, real t_min, real t_max, hit_record &rec) const {
+    point3 current = center(r.time());
+    real root;
+    if (!sphere_intersect(r, current, radius, t_min, t_max, root))
+        return false;
+
+    rec.t = root;
+    sphere_set_hit(r, current, radius, rec);
+    rec.mat_ptr = mat_ptr.get();
+    return true;
+}
+
+bool moving_sphere::occluded(const ray &r, real t_min, real t_max) const {
+    real root;
+    return sphere_intersect(r, center(r.time()), radius, t_min, t_max, root);
+}
+
+bool moving_sphere::bounding_box(aabb &output_box) const {
+    return bounding_box_during(time0, time1, output_box);
+}
+
+// 匀速直线运动，两端的位置就包住了整段路径
+bool moving_sphere::bounding_box_during(double t0, double t1, aabb &output_box) const {
+    vec3 extent(fabs(radius), fabs(radius), fabs(radius));
+    output_box = aabb(center(t0) - extent, center(t0) + extent);
+    output_box.expand(aabb(center(t1) - extent, center(t1) + extent));
+    return true;
+}
+
+#endif
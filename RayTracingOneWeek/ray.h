@@ -35,23 +35,30 @@
 
 #include "vec3.h"
 
-class ray {
+// 光线 A + tb，与vec3_t一样按标量类型模板化。
+// time是光线所在的时刻(秒)，运动的物体用这一时刻的位置求交，快门期间的采样合起来就是运动模糊
+template<typename T>
+class ray_t {
 public:
-    ray() {}
-    ray(const point3& origin, const vec3& direction)
-            : orig(origin), dir(direction)
+    ray_t() {}
+    ray_t(const vec3_t<T>& origin, const vec3_t<T>& direction, T time = 0)
+            : orig(origin), dir(direction), tm(time)
     {}
 
-    point3 origin() const  { return orig; }
-    vec3 direction() const { return dir; }
+    vec3_t<T> origin() const  { return orig; }
+    vec3_t<T> direction() const { return dir; }
+    T time() const { return tm; }
 
-    point3 at(double t) const {
+    vec3_t<T> at(T t) const {
         return orig + t*dir;
     }
 
 public:
-    point3 orig;
-    vec3 dir;
+    vec3_t<T> orig;
+    vec3_t<T> dir;
+    T tm = 0;
 };
 
+typedef ray_t<real> ray;
+
 #endif
\ No newline at end of file
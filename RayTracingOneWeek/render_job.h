@@ -0,0 +1,431 @@
+#pragma once
+#ifndef RENDER_JOB_H
+#define RENDER_JOB_H
+
+#include "rtweekend.h"
+#include "camera.h"
+#include "compiled_scene.h"
+#include "integrator.h"
+#include "wavefront.h"
+#include "sampler.h"
+#include "image_writer.h"
+#include "framebuffer.h"
+#include "checkpoint.h"
+#include "scenes.h"
+#include "scene_file.h"
+#include "settings.h"
+#include "transform.h"
+#include "render_thread.h"
+#include "rt_stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 渲染一个job的完整流程：加载场景、分轮渲染、检查点、写出图像。
+// 渲染程序(main.cpp)和基准测试程序(benchmark.cpp)共用。
+
+// 一个job渲染时用到的全部状态，由设置生成，渲染期间只读
+struct render_context {
+    render_context(const render_settings &settings, const compiled_scene &world)
+            : settings(settings), world(world),
+              cam(settings.lookfrom, settings.lookat, settings.vup, settings.vfov, settings.aspect_ratio,
+                  settings.aperture, settings.focus_dist, settings.time, settings.time + settings.shutter / settings.fps),
+              integrator(settings.max_depth, settings.rr_depth),
+              wavefront(settings.max_depth, settings.rr_depth), use_wavefront(settings.integrator == "wavefront"),
+              image_width(settings.image_width), image_height(settings.image_height()), seed(settings.seed) {
+        parse_sampler_type(settings.sampler.c_str(), sampler_kind);
+    }
+
+    const render_settings &settings;
+    const compiled_scene &world;
+    camera cam;
+    path_integrator integrator;
+    wavefront_integrator wavefront;
+    bool use_wavefront;
+    int image_width, image_height;
+    // 渲染的随机种子，同一种子得到逐位相同的图像
+    uint64_t seed;
+    sampler_type sampler_kind = sampler_type::sobol;
+
+    // 像素(i, j)的第index个采样的采样器和主光线
+    ray primary_ray(int i, int j, int index, sampler &smp) const;
+};
+
+ray render_context::primary_ray(int i, int j, int index, sampler &smp) const {
+    smp = sampler(sampler_kind, seed, i, j, image_width, static_cast<uint32_t>(index), settings.samples_per_pixel);
+    smp.set_dimension(sampler_pixel_dimension);
+    sample_2d jitter = smp.get_2d();
+    double u = (i + jitter.u) / (image_width - 1.0);
+    double v = (j + jitter.v) / (image_height - 1.0);
+    return cam.get_ray(u, v, smp);
+}
+
+// 同一像素的主光线彼此相干，每ray_packet_size个采样作为一个光线包求交，之后每条路径各自追踪。
+// 从第pixel.samples个采样开始再计算count个采样，逐个累加到pixel中。
+// 每个采样的随机数只由(种子, 像素, 采样序号)决定，分几轮渲染、从检查点继续都不影响结果
+void scan_calculate_color(const render_context &ctx, int height, int width, int count, pixel_accum &pixel) {
+    int i = width, j = height;
+    int first_sample = static_cast<int>(pixel.samples);
+
+    ray rays[ray_packet_size];
+    sampler samplers[ray_packet_size];
+    hit_record recs[ray_packet_size];
+    bool hits[ray_packet_size];
+
+    int end_sample = first_sample + count;
+    for (int s0 = first_sample; s0 < end_sample; s0 += ray_packet_size) {
+        int n = std::min(ray_packet_size, end_sample - s0);
+        for (int k = 0; k < n; ++k)
+            rays[k] = ctx.primary_ray(i, j, s0 + k, samplers[k]);
+
+        RT_STAT_RAYS(0, n);
+        ctx.world.hit_packet(rays, n, 0, infinity, recs, hits);
+
+        for (int k = 0; k < n; ++k)
+            pixel.add_sample(ctx.integrator.trace_from_hit(rays[k], hits[k], recs[k], ctx.world, samplers[k]));
+    }
+}
+
+// wavefront模式一次追踪的最多路径数，足够填满各材质的队列，又不至于占用太多内存
+const int wavefront_batch_size = 4096;
+
+// 主光线和它们所属的像素，攒满一批后交给wavefront_integrator
+struct wavefront_batch {
+    std::vector<ray> rays;
+    std::vector<sampler> samplers;
+    std::vector<pixel_accum *> pixels;
+    std::vector<color> radiance;
+};
+
+// 按像素、采样的顺序生成tile中这一轮的全部主光线，每满wavefront_batch_size条整批追踪一次，
+// 再按同样的顺序累加到像素中，随机数和累加顺序都与scan_calculate_color相同。返回追加的采样数
+long long wavefront_calculate_tile(const render_context &ctx, const render_tile &tile, const framebuffer_tile &pixels);
+
+// 这一轮要给像素追加的采样数
+int pass_sample_count(const render_settings &s, const pixel_accum &pixel) {
+    int done = static_cast<int>(pixel.samples);
+    if (done >= s.samples_per_pixel)
+        return 0;
+    if (s.adaptive_threshold > 0 && done >= s.min_samples && pixel.display_error() < s.adaptive_threshold)
+        return 0;
+    return std::min(s.pass_samples, s.samples_per_pixel - done);
+}
+
+// 一个job各阶段的耗时，供基准测试使用
+struct job_timings {
+    // 所有渲染轮次的时间之和
+    double render_seconds = 0;
+    // 色调映射、编码和写出图像(包括热力图和与参考图的比较)
+    double output_seconds = 0;
+    long long samples = 0;
+    // 与设置中参考图的均方根误差，没有参考图时为负
+    double reference_rmse = -1;
+};
+
+long long wavefront_calculate_tile(const render_context &ctx, const render_tile &tile, const framebuffer_tile &pixels) {
+    thread_local wavefront_batch batch;
+    auto flush = [&]() {
+        int n = static_cast<int>(batch.rays.size());
+        batch.radiance.resize(n);
+        ctx.wavefront.trace(batch.rays.data(), batch.samplers.data(), n, ctx.world, batch.radiance.data());
+        for (int k = 0; k < n; ++k)
+            batch.pixels[k]->add_sample(batch.radiance[k]);
+        batch.rays.clear();
+        batch.samplers.clear();
+        batch.pixels.clear();
+    };
+
+    long long added = 0;
+    for (int j = tile.y0; j < tile.y1; ++j)
+        for (int i = tile.x0; i < tile.x1; ++i) {
+            pixel_accum &p = pixels.at(i, j);
+            int count = pass_sample_count(ctx.settings, p);
+            int first_sample = static_cast<int>(p.samples);
+            for (int s = first_sample; s < first_sample + count; ++s) {
+                sampler smp;
+                batch.rays.push_back(ctx.primary_ray(i, j, s, smp));
+                batch.samplers.push_back(smp);
+                batch.pixels.push_back(&p);
+                if (static_cast<int>(batch.rays.size()) == wavefront_batch_size)
+                    flush();
+            }
+            added += count;
+        }
+    flush();
+    return added;
+}
+
+// 按设置创建渲染线程，并为场景选择球体求交的SIMD内核
+render_thread make_renderer(const render_settings &settings, compiled_scene &world) {
+    world.set_simd(settings.simd_isa_or_detected());
+
+    render_thread renderer;
+    renderer.thread_num = settings.threads;
+    renderer.show_progress = settings.progress;
+    if (renderer.thread_num <= 0) {
+        unsigned hardware_threads = std::thread::hardware_concurrency();
+        renderer.thread_num = hardware_threads > 0 ? static_cast<int>(hardware_threads) : 1;
+    }
+    return renderer;
+}
+
+// 分轮渲染到film，直到没有像素还需要采样；设置了检查点时定期保存。
+// 每一轮给还需要采样的像素追加最多pass_samples个采样。timings不为空时累加渲染时间和采样数
+bool render_passes(const render_context &ctx, render_thread &renderer, framebuffer &film, job_timings *timings) {
+    const render_settings &settings = ctx.settings;
+    int image_width = ctx.image_width, image_height = ctx.image_height;
+
+    render_stats stats;
+    auto last_checkpoint = std::chrono::steady_clock::now();
+    for (int pass_index = 1; ; ++pass_index) {
+        std::atomic<long long> pass_added(0);
+        render_stats pass = renderer.run(image_width, image_height, [&](const render_tile &tile) {
+            auto tile_start = std::chrono::steady_clock::now();
+            framebuffer_tile pixels = film.view(tile);
+            long long added = 0;
+            if (ctx.use_wavefront) {
+                added = wavefront_calculate_tile(ctx, tile, pixels);
+            } else {
+                for (int j = tile.y0; j < tile.y1; ++j)
+                    for (int i = tile.x0; i < tile.x1; ++i) {
+                        pixel_accum &p = pixels.at(i, j);
+                        int count = pass_sample_count(settings, p);
+                        if (count > 0) {
+                            scan_calculate_color(ctx, j, i, count, p);
+                            added += count;
+                        }
+                    }
+            }
+            pass_added.fetch_add(added, std::memory_order_relaxed);
+            stats_flush();
+            film.add_tile_time(tile, std::chrono::duration<double>(std::chrono::steady_clock::now() - tile_start).count());
+        });
+        if (pass_added.load() == 0)
+            break;
+        stats.seconds += pass.seconds;
+        stats.tiles += pass.tiles;
+        stats.stolen += pass.stolen;
+        if (timings)
+            timings->samples += pass_added.load();
+        std::cerr << (settings.progress ? "\n" : "") << "pass " << pass_index << ": " << pass_added.load() << " samples, " << pass.seconds << " s\n";
+
+        auto now = std::chrono::steady_clock::now();
+        if (!settings.checkpoint.empty() &&
+            std::chrono::duration<double>(now - last_checkpoint).count() >= settings.checkpoint_interval) {
+            if (!write_checkpoint(settings.checkpoint, film, ctx.seed, ctx.sampler_kind, settings.samples_per_pixel))
+                return false;
+            last_checkpoint = now;
+        }
+    }
+    if (!settings.checkpoint.empty() &&
+        !write_checkpoint(settings.checkpoint, film, ctx.seed, ctx.sampler_kind, settings.samples_per_pixel))
+        return false;
+
+    double pixel_count = static_cast<double>(image_width) * image_height;
+    std::cerr << "render: " << stats.seconds << " s, " << settings.integrator << " integrator, "
+              << settings.sampler << " sampler, "
+              << renderer.thread_num << " threads, "
+              << stats.tiles << " tiles (" << stats.stolen << " stolen), "
+              << film.total_samples() / pixel_count << " spp average\n";
+
+    // tile耗时的分布：最慢的tile与平均值差得越多，负载越不均衡
+    const std::vector<double> &tile_times = film.tile_times();
+    if (!tile_times.empty()) {
+        auto range = std::minmax_element(tile_times.begin(), tile_times.end());
+        double sum = 0;
+        for (double seconds : tile_times)
+            sum += seconds;
+        std::cerr << "tile time: min " << *range.first * 1000 << " ms, mean " << sum / tile_times.size() * 1000
+                  << " ms, max " << *range.second * 1000 << " ms\n";
+    }
+
+    if (timings)
+        timings->render_seconds += stats.seconds;
+    return true;
+}
+
+// 写出图像和热力图，设置了参考图时输出与它的误差，rmse不为空时也写到rmse
+bool write_job_images(const render_settings &settings, const framebuffer &film, double *rmse = nullptr) {
+    int image_width = film.width(), image_height = film.height();
+
+    // 输出图像：PFM保存线性的平均颜色，其他格式保存gamma校正后的8位颜色
+    std::vector<unsigned char> rgb = film.tonemap();
+    std::vector<float> hdr = film.resolve();
+    if (!write_image(settings.output, image_width, image_height, rgb.data(), hdr.data()))
+        return false;
+
+    if (!settings.heatmap.empty()) {
+        std::vector<unsigned char> heat = film.sample_heatmap(settings.samples_per_pixel);
+        std::vector<float> heat_hdr(heat.size());
+        for (int y = 0; y < image_height; ++y)
+            for (int x = 0; x < image_width; ++x) {
+                size_t k = (static_cast<size_t>(y) * image_width + x) * 3;
+                heat_hdr[k] = heat_hdr[k + 1] = heat_hdr[k + 2] =
+                        static_cast<float>(film.at(x, image_height - 1 - y).samples);
+            }
+        if (!write_image(settings.heatmap, image_width, image_height, heat.data(), heat_hdr.data()))
+            return false;
+    }
+
+    if (!settings.tile_heatmap.empty()) {
+        std::vector<unsigned char> heat = film.time_heatmap();
+        std::vector<float> heat_hdr(heat.size());
+        for (int y = 0; y < image_height; ++y)
+            for (int x = 0; x < image_width; ++x) {
+                size_t k = (static_cast<size_t>(y) * image_width + x) * 3;
+                heat_hdr[k] = heat_hdr[k + 1] = heat_hdr[k + 2] =
+                        static_cast<float>(film.tile_time(x, image_height - 1 - y));
+            }
+        if (!write_image(settings.tile_heatmap, image_width, image_height, heat.data(), heat_hdr.data()))
+            return false;
+    }
+
+    // 和参考图比较线性颜色，用来衡量浮点精度、采样方式等对图像的影响
+    if (!settings.reference.empty()) {
+        int ref_width, ref_height;
+        std::vector<float> ref;
+        if (!read_pfm(settings.reference, ref_width, ref_height, ref))
+            return false;
+        if (ref_width != image_width || ref_height != image_height) {
+            std::cerr << "reference " << settings.reference << " is " << ref_width << "x" << ref_height << "\n";
+            return false;
+        }
+        double sum = 0;
+        for (size_t k = 0; k < ref.size(); ++k)
+            sum += (static_cast<double>(hdr[k]) - ref[k]) * (hdr[k] - ref[k]);
+        double error = std::sqrt(sum / ref.size());
+        std::cerr << "rmse vs " << settings.reference << ": " << error << "\n";
+        if (rmse)
+            *rmse = error;
+    }
+
+    return true;
+}
+
+// 渲染一个job并写出图像，出错时返回false。timings不为空时填写各阶段的耗时
+bool render_job(const render_settings &settings, compiled_scene &world, job_timings *timings = nullptr) {
+    render_thread renderer = make_renderer(settings, world);
+    world.set_time(settings.time, settings.shutter / settings.fps);
+    render_context ctx(settings, world);
+    framebuffer film(ctx.image_width, ctx.image_height, renderer.tile_size);
+    if (settings.resume) {
+        // 继续渲染必须使用检查点的种子，否则新旧采样会重复使用同样的随机数序列；
+        // 采样器和spp也必须相同，read_checkpoint拒绝不一致的检查点
+        if (!read_checkpoint(settings.checkpoint, film, ctx.seed, ctx.sampler_kind, settings.samples_per_pixel))
+            return false;
+        std::cerr << "resumed " << settings.checkpoint << " at "
+                  << film.total_samples() / (static_cast<double>(ctx.image_width) * ctx.image_height) << " spp\n";
+    }
+
+    if (!render_passes(ctx, renderer, film, timings))
+        return false;
+
+    auto output_start = std::chrono::steady_clock::now();
+    bool written = write_job_images(settings, film, timings ? &timings->reference_rmse : nullptr);
+    if (timings)
+        timings->output_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - output_start).count();
+    return written;
+}
+
+// 动画第frame帧的设置：相机沿关键帧插值后再按turntable旋转，输出文件名带上帧号。
+// 每一帧使用不同的种子，噪点不会像贴在镜头上一样固定不动
+render_settings frame_settings(const render_settings &s, int frame) {
+    render_settings f = s;
+    interpolate_camera(s.keyframes, frame, f.lookfrom, f.lookat);
+    if (s.turntable != 0) {
+        double degrees = s.turntable * (frame - s.first_frame) / (s.last_frame - s.first_frame + 1);
+        f.lookfrom = f.lookat + affine_transform::rotate(s.vup, degrees).vector(f.lookfrom - f.lookat);
+    }
+    // 对焦距离与相机到注视点的距离保持同样的比例
+    double base_distance = (s.lookfrom - s.lookat).length();
+    if (base_distance > 0)
+        f.focus_dist = s.focus_dist * (f.lookfrom - f.lookat).length() / base_distance;
+    f.time = frame / s.fps;
+    f.seed = s.seed + static_cast<uint64_t>(frame);
+    f.output = frame_output_path(s.output, frame);
+    if (!s.heatmap.empty())
+        f.heatmap = frame_output_path(s.heatmap, frame);
+    if (!s.tile_heatmap.empty())
+        f.tile_heatmap = frame_output_path(s.tile_heatmap, frame);
+    return f;
+}
+
+// 在一个进程里渲染动画的所有帧。场景只构建一次，每一帧只refit运动的球的BVH。
+// 两个framebuffer轮流使用：第N帧在后台线程写出的同时渲染第N+1帧
+bool render_animation(const render_settings &settings, compiled_scene &world, job_timings *timings = nullptr) {
+    render_thread renderer = make_renderer(settings, world);
+    int image_width = settings.image_width, image_height = settings.image_height();
+    std::unique_ptr<framebuffer> films[2];
+    for (auto &film : films)
+        film.reset(new framebuffer(image_width, image_height, renderer.tile_size));
+    render_settings frames[2];
+    std::future<bool> writing;
+    bool ok = true;
+
+    int frame_count = settings.last_frame - settings.first_frame + 1;
+    for (int frame = settings.first_frame; frame <= settings.last_frame && ok; ++frame) {
+        // 后台线程只可能在写另一个framebuffer(上一帧)
+        int slot = (frame - settings.first_frame) % 2;
+        frames[slot] = frame_settings(settings, frame);
+
+        auto refit_start = std::chrono::steady_clock::now();
+        world.set_time(frames[slot].time, settings.shutter / settings.fps);
+        double refit_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - refit_start).count();
+        std::cerr << "frame " << frame << " (" << frame - settings.first_frame + 1 << "/" << frame_count << "): "
+                  << frames[slot].output << ", refit " << refit_seconds * 1000 << " ms\n";
+
+        framebuffer &film = *films[slot];
+        film.clear();
+        render_context ctx(frames[slot], world);
+        if (!render_passes(ctx, renderer, film, timings))
+            ok = false;
+
+        // 上一帧写完之后才能复用它的framebuffer
+        if (writing.valid() && !writing.get())
+            ok = false;
+        if (ok)
+            writing = std::async(std::launch::async, [&frames, &films, slot]() {
+                return write_job_images(frames[slot], *films[slot]);
+            });
+    }
+    if (writing.valid() && !writing.get())
+        ok = false;
+
+    // 场景可能被之后的job复用，恢复到第0秒
+    world.set_time(0);
+    return ok;
+}
+
+// name是内置场景的名字、文本场景文件或者二进制场景文件(.rtscene)。
+// BVH的叶子按isa一次处理的球数打包，应与渲染时选择的指令集相同
+bool load_scene(const std::string &name, compiled_scene &scene, simd_isa isa) {
+    const std::string binary_ext = ".rtscene";
+    if (name.size() > binary_ext.size() && name.compare(name.size() - binary_ext.size(), binary_ext.size(), binary_ext) == 0)
+        return load_scene_binary(name, scene, isa);
+
+    hittable_list objects;
+    scene_background background;
+    if (!make_scene(name, objects, background, isa) && !read_scene_text(name, objects, background, isa))
+        return false;
+    scene = compile_scene(objects, isa);
+    scene.background = background;
+    return true;
+}
+
+// 保存场景，.rtscene为二进制格式，其他为文本格式
+bool export_scene(const std::string &path, const compiled_scene &scene) {
+    const std::string binary_ext = ".rtscene";
+    if (path.size() > binary_ext.size() && path.compare(path.size() - binary_ext.size(), binary_ext.size(), binary_ext) == 0)
+        return write_scene_binary(path, scene);
+    return write_scene_text(path, scene);
+}
+
+#endif
@@ -1,8 +1,148 @@
 #ifndef RENDER_THREAD_H
 #define RENDER_THREAD_H
-class render_thread{
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 图像中的一块矩形区域 [x0, x1) x [y0, y1)
+struct render_tile {
+    int x0, y0, x1, y1;
+};
+
+// 一次渲染的统计信息，用来衡量多线程的扩展性
+struct render_stats {
+    double seconds = 0;
+    int tiles = 0;
+    int stolen = 0;
+    std::vector<int> tiles_per_thread;
+};
+
+// 把图像切分为tile，交给thread_num个工作线程渲染。
+// 每个线程拥有自己的tile队列，从队首取；自己的队列空了就从别的线程队尾偷取，
+// 这样玻璃/金属较多的慢tile不会让其他核心空闲。
+// 不同tile覆盖的像素互不重叠，所以tile_func写自己的像素时不需要加锁。
+class render_thread {
 public:
     int thread_num = 8;
+    int tile_size = 16;
+    // 在标准错误上显示剩余的tile数，基准测试时关闭
+    bool show_progress = true;
+
+    template<typename TileFunc>
+    render_stats run(int width, int height, TileFunc &&tile_func);
+
+private:
+    struct work_queue {
+        std::mutex lock;
+        std::deque<render_tile> tiles;
+    };
+
+    static bool pop_front(work_queue &q, render_tile &tile);
+
+    static bool steal_back(work_queue &q, render_tile &tile);
 };
 
+bool render_thread::pop_front(work_queue &q, render_tile &tile) {
+    std::lock_guard<std::mutex> guard(q.lock);
+    if (q.tiles.empty())
+        return false;
+    tile = q.tiles.front();
+    q.tiles.pop_front();
+    return true;
+}
+
+bool render_thread::steal_back(work_queue &q, render_tile &tile) {
+    std::lock_guard<std::mutex> guard(q.lock);
+    if (q.tiles.empty())
+        return false;
+    tile = q.tiles.back();
+    q.tiles.pop_back();
+    return true;
+}
+
+template<typename TileFunc>
+render_stats render_thread::run(int width, int height, TileFunc &&tile_func) {
+    int workers = std::max(1, thread_num);
+    int size = std::max(1, tile_size);
+
+    // tile的边界对齐到size的整数倍(framebuffer按同样的网格分块存放)，
+    // 从上往下、从左往右排列
+    int tiles_x = (width + size - 1) / size;
+    int tiles_y = (height + size - 1) / size;
+    std::vector<render_tile> tiles;
+    for (int ty = tiles_y - 1; ty >= 0; --ty)
+        for (int tx = 0; tx < tiles_x; ++tx)
+            tiles.push_back({tx * size, ty * size, std::min(width, (tx + 1) * size), std::min(height, (ty + 1) * size)});
+
+    // 每个线程先分到一段连续的tile，保持访存的局部性
+    std::vector<work_queue> queues(workers);
+    for (size_t k = 0; k < tiles.size(); ++k)
+        queues[k * workers / tiles.size()].tiles.push_back(tiles[k]);
+
+    render_stats stats;
+    stats.tiles = static_cast<int>(tiles.size());
+    stats.tiles_per_thread.assign(workers, 0);
+
+    std::atomic<int> tiles_done(0);
+    std::atomic<int> stolen(0);
+    std::mutex done_lock;
+    std::condition_variable done_signal;
+
+    auto worker = [&](int id) {
+        render_tile tile{};
+        int rendered = 0;
+        while (true) {
+            if (!pop_front(queues[id], tile)) {
+                bool found = false;
+                for (int k = 1; k < workers && !found; ++k)
+                    found = steal_back(queues[(id + k) % workers], tile);
+                if (!found)
+                    break;
+                stolen.fetch_add(1, std::memory_order_relaxed);
+            }
+            tile_func(tile);
+            ++rendered;
+            if (tiles_done.fetch_add(1, std::memory_order_relaxed) + 1 == stats.tiles) {
+                std::lock_guard<std::mutex> guard(done_lock);
+                done_signal.notify_all();
+            }
+        }
+        stats.tiles_per_thread[id] = rendered;
+    };
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> pool;
+    pool.reserve(workers);
+    for (int id = 0; id < workers; ++id)
+        pool.emplace_back(worker, id);
+
+    // 主线程只负责显示进度，全部tile完成时立即被唤醒
+    int total = stats.tiles;
+    {
+        std::unique_lock<std::mutex> guard(done_lock);
+        while (tiles_done.load(std::memory_order_relaxed) < total) {
+            if (show_progress)
+                std::cerr << "\rtiles remaining: " << total - tiles_done.load(std::memory_order_relaxed) << ' ' << std::flush;
+            done_signal.wait_for(guard, std::chrono::milliseconds(200));
+        }
+    }
+    if (show_progress)
+        std::cerr << "\rtiles remaining: 0 " << std::flush;
+
+    for (auto &t : pool)
+        t.join();
+
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    stats.stolen = stolen.load();
+    return stats;
+}
+
 #endif //RENDER_THREAD_H
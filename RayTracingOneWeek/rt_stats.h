@@ -0,0 +1,131 @@
+#pragma once
+#ifndef RT_STATS_H
+#define RT_STATS_H
+
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+
+// 渲染统计：各深度的光线数、包围盒测试数、图元求交数、各种材质的散射次数和路径结束的原因。
+// 只有定义了RT_STATS才计数(RayTracingBenchmarkStats总是定义它，渲染程序用cmake -DRT_STATS=ON打开)，
+// 否则RT_STAT_ADD/RT_STAT_RAYS展开为空，正常构建没有任何开销。
+// 计数器是线程局部的，渲染线程每完成一块tile调用一次stats_flush()合并到全局总数，热路径上不需要原子操作。
+
+// 按深度统计光线数时的深度上限，更深的光线都计入最后一项
+const int ray_stat_depths = 16;
+
+struct ray_counters {
+    // 求交的光线数，rays_by_depth[0]是主光线，[d]是第d次弹射后的光线
+    uint64_t rays = 0;
+    uint64_t rays_by_depth[ray_stat_depths] = {};
+    // BVH节点的包围盒测试数，以及球、三角形、长方体等图元的求交测试数
+    uint64_t node_tests = 0;
+    uint64_t primitive_tests = 0;
+    // 球的求交测试数，以及其中交点在[t_min, t_max]内(比当前最近的撞点更近)的次数
+    uint64_t sphere_tests = 0;
+    uint64_t sphere_hits = 0;
+    // 各种材质的scatter调用次数
+    uint64_t scatter_lambertian = 0;
+    uint64_t scatter_metal = 0;
+    uint64_t scatter_dielectric = 0;
+    // 路径结束的原因：达到max_depth、俄罗斯轮盘赌、材质吸收(scatter返回false)
+    uint64_t paths_max_depth = 0;
+    uint64_t paths_roulette = 0;
+    uint64_t paths_absorbed = 0;
+    // 直接光照的阴影光线，以及其中被挡住的数量
+    uint64_t shadow_rays = 0;
+    uint64_t shadow_blocked = 0;
+
+    uint64_t primary_rays() const { return rays_by_depth[0]; }
+
+    void add_rays(int depth, uint64_t n) {
+        rays += n;
+        rays_by_depth[depth < ray_stat_depths ? depth : ray_stat_depths - 1] += n;
+    }
+
+    ray_counters &operator+=(const ray_counters &rhs);
+};
+
+ray_counters &ray_counters::operator+=(const ray_counters &rhs) {
+    rays += rhs.rays;
+    for (int d = 0; d < ray_stat_depths; ++d)
+        rays_by_depth[d] += rhs.rays_by_depth[d];
+    node_tests += rhs.node_tests;
+    primitive_tests += rhs.primitive_tests;
+    sphere_tests += rhs.sphere_tests;
+    sphere_hits += rhs.sphere_hits;
+    scatter_lambertian += rhs.scatter_lambertian;
+    scatter_metal += rhs.scatter_metal;
+    scatter_dielectric += rhs.scatter_dielectric;
+    paths_max_depth += rhs.paths_max_depth;
+    paths_roulette += rhs.paths_roulette;
+    paths_absorbed += rhs.paths_absorbed;
+    shadow_rays += rhs.shadow_rays;
+    shadow_blocked += rhs.shadow_blocked;
+    return *this;
+}
+
+inline ray_counters &thread_counters() {
+    thread_local ray_counters counters;
+    return counters;
+}
+
+#ifdef RT_STATS
+#define RT_STAT_ADD(name, n) (thread_counters().name += static_cast<uint64_t>(n))
+#define RT_STAT_RAYS(depth, n) (thread_counters().add_rays((depth), static_cast<uint64_t>(n)))
+#else
+#define RT_STAT_ADD(name, n) ((void)0)
+#define RT_STAT_RAYS(depth, n) ((void)0)
+#endif
+
+struct stats_totals {
+    std::mutex lock;
+    ray_counters total;
+};
+
+inline stats_totals &global_stats() {
+    static stats_totals totals;
+    return totals;
+}
+
+// 把当前线程的计数合并到全局总数并清零
+inline void stats_flush() {
+#ifdef RT_STATS
+    ray_counters &local = thread_counters();
+    stats_totals &totals = global_stats();
+    std::lock_guard<std::mutex> guard(totals.lock);
+    totals.total += local;
+    local = ray_counters();
+#endif
+}
+
+// 取出全局总数并清零，下一次渲染从0开始计数
+inline ray_counters stats_take() {
+    stats_totals &totals = global_stats();
+    std::lock_guard<std::mutex> guard(totals.lock);
+    ray_counters result = totals.total;
+    totals.total = ray_counters();
+    return result;
+}
+
+// 打印计数器的汇总，每条光线的平均值与比例更便于在不同场景之间比较
+void print_ray_counters(std::ostream &out, const ray_counters &c) {
+    double rays = c.rays > 0 ? static_cast<double>(c.rays) : 1.0;
+    double paths = c.primary_rays() > 0 ? static_cast<double>(c.primary_rays()) : 1.0;
+    out << "rays: " << c.rays << " (" << c.primary_rays() << " primary), "
+        << c.node_tests / rays << " node tests/ray, " << c.primitive_tests / rays << " primitive tests/ray\n"
+        << "rays by depth:";
+    for (int d = 0; d < ray_stat_depths; ++d)
+        if (c.rays_by_depth[d] > 0)
+            out << ' ' << d << (d == ray_stat_depths - 1 ? "+" : "") << ':' << c.rays_by_depth[d];
+    out << "\nsphere tests: " << c.sphere_tests << ", hits: " << c.sphere_hits << " ("
+        << (c.sphere_tests > 0 ? 100.0 * c.sphere_hits / c.sphere_tests : 0.0) << "%)\n"
+        << "scatter: lambertian " << c.scatter_lambertian << ", metal " << c.scatter_metal
+        << ", dielectric " << c.scatter_dielectric << "\n"
+        << "paths ended by max depth: " << c.paths_max_depth << " (" << 100.0 * c.paths_max_depth / paths
+        << "%), roulette: " << c.paths_roulette << ", absorbed: " << c.paths_absorbed << "\n"
+        << "shadow rays: " << c.shadow_rays << " (" << (c.shadow_rays > 0 ? 100.0 * c.shadow_blocked / c.shadow_rays : 0.0)
+        << "% blocked)\n";
+}
+
+#endif
@@ -4,8 +4,9 @@
 #include <cmath>
 #include <limits>
 #include <memory>
-#include <random>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
 
 // Usings
 
@@ -13,6 +14,40 @@ using std::shared_ptr;
 using std::make_shared;
 using std::sqrt;
 
+// 渲染使用的浮点类型。定义RT_USE_FLOAT时使用float：SIMD一次处理的元素加倍，场景数据的内存减半
+#ifdef RT_USE_FLOAT
+typedef float real;
+#else
+typedef double real;
+#endif
+
+// 浮点运算误差的上界 n * u / (1 - n * u)，u为real的单位舍入误差：n次舍入后的相对误差不超过它
+inline constexpr real error_gamma(int n) {
+    return n * (std::numeric_limits<real>::epsilon() * real(0.5)) /
+           (1 - n * (std::numeric_limits<real>::epsilon() * real(0.5)));
+}
+
+// 朝正/负方向移动一个ULP。直接改位模式，比std::nextafter快(后者是库函数调用)。
+// 不处理无穷大和NaN，调用者保证x是有限值
+template<typename T, typename Bits>
+inline T step_ulp(T x, bool up) {
+    Bits bits;
+    std::memcpy(&bits, &x, sizeof(x));
+    if (x == 0)
+        bits = up ? 1 : Bits(1) << (sizeof(Bits) * 8 - 1) | 1;
+    else if ((x > 0) == up)
+        ++bits;
+    else
+        --bits;
+    std::memcpy(&x, &bits, sizeof(x));
+    return x;
+}
+
+inline float next_float_up(float x) { return step_ulp<float, uint32_t>(x, true); }
+inline float next_float_down(float x) { return step_ulp<float, uint32_t>(x, false); }
+inline double next_float_up(double x) { return step_ulp<double, uint64_t>(x, true); }
+inline double next_float_down(double x) { return step_ulp<double, uint64_t>(x, false); }
+
 // Constants
 
 const double infinity = std::numeric_limits<double>::infinity();
@@ -24,10 +59,58 @@ inline double degrees_to_radians(double degrees) {
     return degrees * pi / 180.0;
 }
 
+// PCG32随机数生成器 (O'Neill, pcg-random.org)：64位状态，输出32位
+// 比mt19937小得多也快得多，并且可以按(state, stream)直接定位到某个序列
+class pcg32 {
+public:
+    pcg32() { seed(0x853c49e6748fea9bULL, 0xda3e39cb94b95bdbULL); }
+
+    pcg32(uint64_t init_state, uint64_t init_stream) { seed(init_state, init_stream); }
+
+    void seed(uint64_t init_state, uint64_t init_stream) {
+        state = 0u;
+        inc = (init_stream << 1u) | 1u;
+        next_uint();
+        state += init_state;
+        next_uint();
+    }
+
+    uint32_t next_uint() {
+        uint64_t old_state = state;
+        state = old_state * 6364136223846793005ULL + inc;
+        auto xorshifted = static_cast<uint32_t>(((old_state >> 18u) ^ old_state) >> 27u);
+        auto rot = static_cast<uint32_t>(old_state >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((~rot + 1u) & 31u));
+    }
+
+    // [0, 1)
+    double next_double() {
+        return next_uint() * (1.0 / 4294967296.0);
+    }
+
+private:
+    uint64_t state;
+    uint64_t inc;
+};
+
+// splitmix64的混合函数，把相邻的整数打散成互不相关的种子
+inline uint64_t mix_bits(uint64_t v) {
+    v ^= v >> 30;
+    v *= 0xbf58476d1ce4e5b9ULL;
+    v ^= v >> 27;
+    v *= 0x94d049bb133111ebULL;
+    v ^= v >> 31;
+    return v;
+}
+
+// 每个线程独立的生成器，多线程渲染时没有数据竞争
+inline pcg32 &thread_rng() {
+    thread_local pcg32 rng;
+    return rng;
+}
+
 inline double random_double() {
-    static std::uniform_real_distribution<double> distribution(0.0, 1.0);
-    static std::mt19937 generator;
-    return distribution(generator);
+    return thread_rng().next_double();
 }
 
 // return a random value in the interval between min value and max value
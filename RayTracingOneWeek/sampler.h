@@ -0,0 +1,388 @@
+#pragma once
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "rtweekend.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// 采样器：一个采样(像素, 采样序号)用到的全部随机数按维度编号，从采样器中依次取出。
+//   independent  每一维都是独立的伪随机数
+//   stratified   每一维把[0,1)(二维时是单位正方形)分成samples_per_pixel个格子，每个采样落在不同的格子里，
+//                格子的顺序在各维之间用哈希置换打乱，维度之间不相关
+//   sobol        Owen扰乱的Sobol序列，每一对维度都是(0,2)序列，前2^k个采样分层最均匀。
+//                只用Sobol的前两维，更高的维度用不同的种子打乱采样序号(Burley 2020的padding)
+//   blue-noise   所有像素使用同一个Owen扰乱的Sobol序列，再按蓝噪声纹理给每个像素一个环面平移，
+//                误差在屏幕上呈蓝噪声分布，低采样数时比白噪声更不显眼
+// 采样器只有几十个字节，可以复制保存，之后从同一维继续取值(wavefront积分器为每条路径保存一份)。
+enum class sampler_type {
+    independent, stratified, sobol, blue_noise
+};
+
+const char *sampler_type_name(sampler_type type) {
+    switch (type) {
+        case sampler_type::stratified:
+            return "stratified";
+        case sampler_type::sobol:
+            return "sobol";
+        case sampler_type::blue_noise:
+            return "blue-noise";
+        default:
+            return "independent";
+    }
+}
+
+bool parse_sampler_type(const char *name, sampler_type &type) {
+    for (sampler_type candidate : {sampler_type::independent, sampler_type::stratified, sampler_type::sobol,
+                                   sampler_type::blue_noise}) {
+        if (std::strcmp(name, sampler_type_name(candidate)) == 0) {
+            type = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+// 维度的分配：前5维是像素内的位置、镜头上的位置和快门时刻，之后第depth次弹射从bounce_dimension(depth)开始，
+// 每次弹射固定占sampler_bounce_dimensions维(散射方向2维、散射的选择1维、选择光源1维、光源上的方向2维、
+// 俄罗斯轮盘赌1维)。不同材质用掉的维数不同，也不会让后面弹射的维度错位
+const uint32_t sampler_pixel_dimension = 0;
+const uint32_t sampler_lens_dimension = 2;
+const uint32_t sampler_time_dimension = 4;
+const uint32_t sampler_bounce_dimensions = 7;
+
+inline uint32_t bounce_dimension(int depth) {
+    return 5 + sampler_bounce_dimensions * static_cast<uint32_t>(depth - 1);
+}
+
+// 直接光照从这次弹射的第4维开始取3维
+inline uint32_t light_dimension(int depth) {
+    return bounce_dimension(depth) + 3;
+}
+
+// 俄罗斯轮盘赌使用这次弹射的最后一维
+inline uint32_t roulette_dimension(int depth) {
+    return bounce_dimension(depth) + sampler_bounce_dimensions - 1;
+}
+
+struct sample_2d {
+    double u, v;
+};
+
+inline uint32_t hash_bits(uint64_t a, uint64_t b) {
+    return static_cast<uint32_t>(mix_bits(a ^ mix_bits(b)));
+}
+
+inline uint32_t reverse_bits(uint32_t x) {
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+    x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+    x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+    x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+    return x;
+}
+
+// Owen扰乱：每一位按它更高的全部位翻转，哈希实现(Burley, Practical Hash-based Owen Scrambling)
+inline uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) {
+    x = reverse_bits(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return reverse_bits(x);
+}
+
+// Sobol序列第二维(本原多项式x + 1)的32位定点数，第一维就是reverse_bits(index)
+inline uint32_t sobol_second_dimension(uint32_t index) {
+    uint32_t result = 0;
+    for (uint32_t v = 0x80000000u; index; index >>= 1, v ^= v >> 1)
+        if (index & 1)
+            result ^= v;
+    return result;
+}
+
+// 打乱序号并Owen扰乱的二维Sobol点，返回32位定点数
+inline void scrambled_sobol_2d(uint32_t index, uint32_t seed, uint32_t &x, uint32_t &y) {
+    index = nested_uniform_scramble(index, seed);
+    x = nested_uniform_scramble(reverse_bits(index), hash_bits(seed, 1));
+    y = nested_uniform_scramble(sobol_second_dimension(index), hash_bits(seed, 2));
+}
+
+// 把[0, l)内的i映射到[0, l)的一个排列，p选择排列(Kensler, Correlated Multi-Jittered Sampling)
+inline uint32_t permute_index(uint32_t i, uint32_t l, uint32_t p) {
+    uint32_t w = l - 1;
+    w |= w >> 1;
+    w |= w >> 2;
+    w |= w >> 4;
+    w |= w >> 8;
+    w |= w >> 16;
+    do {
+        i ^= p;
+        i *= 0xe170893du;
+        i ^= p >> 16;
+        i ^= (i & w) >> 4;
+        i ^= p >> 8;
+        i *= 0x0929eb3fu;
+        i ^= p >> 23;
+        i ^= (i & w) >> 1;
+        i *= 1 | p >> 27;
+        i *= 0x6935fa69u;
+        i ^= (i & w) >> 11;
+        i *= 0x74dcb303u;
+        i ^= (i & w) >> 2;
+        i *= 0x9e501cc3u;
+        i ^= (i & w) >> 2;
+        i *= 0xc860a3dfu;
+        i &= w;
+        i ^= i >> 5;
+    } while (i >= l);
+    return (i + p) % l;
+}
+
+// 蓝噪声纹理的边长(2的幂)，纹理在屏幕上平铺
+const int blue_noise_size = 64;
+
+// 用void-and-cluster方法(Ulichney 1993)生成的蓝噪声纹理，每个像素是它在[0,1)内的秩。
+// 能量是环面上的高斯核之和，每次在能量最高的1处(最密的簇)移除、在能量最低的0处(最大的空洞)加入
+std::vector<float> make_blue_noise(int size, uint64_t seed) {
+    const int n = size * size, mask = size - 1;
+    const double sigma = 1.5;
+    std::vector<double> kernel(n);
+    for (int dy = 0; dy < size; ++dy)
+        for (int dx = 0; dx < size; ++dx) {
+            int x = std::min(dx, size - dx), y = std::min(dy, size - dy);
+            kernel[dy * size + dx] = std::exp(-(x * x + y * y) / (2 * sigma * sigma));
+        }
+
+    std::vector<unsigned char> pattern(n, 0);
+    std::vector<double> energy(n, 0.0);
+    auto toggle = [&](std::vector<unsigned char> &bits, std::vector<double> &e, int p, bool on) {
+        bits[p] = on;
+        int px = p & mask, py = p / size;
+        double sign = on ? 1.0 : -1.0;
+        for (int y = 0; y < size; ++y)
+            for (int x = 0; x < size; ++x)
+                e[y * size + x] += sign * kernel[((y - py) & mask) * size + ((x - px) & mask)];
+    };
+    // 值为value的像素中能量最高(tightest)或最低的一个
+    auto extreme = [&](const std::vector<unsigned char> &bits, const std::vector<double> &e, bool value,
+                       bool highest) {
+        int best = -1;
+        for (int p = 0; p < n; ++p)
+            if (bits[p] == value && (best < 0 || (highest ? e[p] > e[best] : e[p] < e[best])))
+                best = p;
+        return best;
+    };
+
+    // 初始的二值图：随机放置十分之一的1，再反复把最密的簇移到最大的空洞，直到没有可以移动的点
+    pcg32 rng(seed, 0);
+    int ones = n / 10;
+    for (int placed = 0; placed < ones;) {
+        int p = static_cast<int>(rng.next_uint() % n);
+        if (!pattern[p]) {
+            toggle(pattern, energy, p, true);
+            ++placed;
+        }
+    }
+    for (int moves = 0; moves < n; ++moves) {
+        int cluster = extreme(pattern, energy, true, true);
+        toggle(pattern, energy, cluster, false);
+        int hole = extreme(pattern, energy, false, false);
+        toggle(pattern, energy, hole, true);
+        if (hole == cluster)
+            break;
+    }
+
+    std::vector<int> rank(n);
+    // 初始图中的1：依次移除最密的簇，秩从ones - 1递减
+    std::vector<unsigned char> bits = pattern;
+    std::vector<double> e = energy;
+    for (int r = ones - 1; r >= 0; --r) {
+        int cluster = extreme(bits, e, true, true);
+        toggle(bits, e, cluster, false);
+        rank[cluster] = r;
+    }
+    // 其余的像素：依次填入最大的空洞，秩从ones递增
+    for (int r = ones; r < n; ++r) {
+        int hole = extreme(pattern, energy, false, false);
+        toggle(pattern, energy, hole, true);
+        rank[hole] = r;
+    }
+
+    std::vector<float> texture(n);
+    for (int p = 0; p < n; ++p)
+        texture[p] = static_cast<float>((rank[p] + 0.5) / n);
+    return texture;
+}
+
+// 第一次使用时生成(约几十毫秒)，之后所有线程共用
+inline const std::vector<float> &blue_noise_texture() {
+    static const std::vector<float> texture = make_blue_noise(blue_noise_size, 0x5eed);
+    return texture;
+}
+
+class sampler {
+public:
+    sampler() {}
+
+    // 像素(x, y)的第index个采样。samples_per_pixel只有stratified使用，决定每一维分成多少格
+    sampler(sampler_type type, uint64_t seed, int x, int y, int width, uint32_t index, int samples_per_pixel);
+
+    // 下一个值从第d维取
+    void set_dimension(uint32_t d) { dimension = d; }
+
+    // [0, 1)
+    double get_1d();
+
+    // [0, 1)^2，占两维
+    sample_2d get_2d();
+
+private:
+    // 第d维(二维时是从d开始的一对维度)的种子，同一像素的各个采样相同
+    uint32_t dimension_seed(uint32_t d) const { return hash_bits(pixel_seed, d); }
+
+    // 蓝噪声纹理在第d维的平移量，每一维从纹理中不同的位置取值
+    double blue_noise_shift(uint32_t d) const;
+
+    static double to_unit(uint32_t bits) { return bits * (1.0 / 4294967296.0); }
+
+    static double wrap(double x) { return x >= 1.0 ? x - 1.0 : x; }
+
+private:
+    sampler_type type = sampler_type::independent;
+    uint32_t dimension = 0;
+    uint32_t index = 0;
+    uint32_t strata = 1;
+    // stratified和sobol每个像素不同，blue-noise所有像素相同
+    uint32_t pixel_seed = 0;
+    int px = 0, py = 0;
+    // independent的随机数
+    pcg32 rng;
+};
+
+sampler::sampler(sampler_type type, uint64_t seed, int x, int y, int width, uint32_t index, int samples_per_pixel)
+        : type(type), index(index), strata(static_cast<uint32_t>(std::max(1, samples_per_pixel))), px(x), py(y) {
+    // 每个采样的随机数只取决于(seed, 像素, 采样序号)，与线程数量和tile的调度顺序无关
+    uint64_t pixel = static_cast<uint64_t>(y) * width + x;
+    if (type == sampler_type::independent)
+        rng.seed(mix_bits(seed ^ mix_bits(index)), mix_bits(seed + pixel));
+    pixel_seed = type == sampler_type::blue_noise ? hash_bits(seed, 0) : hash_bits(seed, pixel + 1);
+}
+
+double sampler::blue_noise_shift(uint32_t d) const {
+    uint32_t h = hash_bits(pixel_seed ^ 0xb1e5u, d);
+    int x = (px + static_cast<int>(h & 0xffff)) & (blue_noise_size - 1);
+    int y = (py + static_cast<int>(h >> 16)) & (blue_noise_size - 1);
+    return blue_noise_texture()[y * blue_noise_size + x];
+}
+
+double sampler::get_1d() {
+    uint32_t d = dimension++;
+    switch (type) {
+        case sampler_type::stratified: {
+            uint32_t seed = dimension_seed(d);
+            uint32_t stratum = permute_index(index % strata, strata, seed);
+            return (stratum + to_unit(hash_bits(seed, index))) / strata;
+        }
+        case sampler_type::sobol:
+        case sampler_type::blue_noise: {
+            uint32_t x, y;
+            scrambled_sobol_2d(index, dimension_seed(d), x, y);
+            if (type == sampler_type::sobol)
+                return to_unit(x);
+            return wrap(to_unit(x) + blue_noise_shift(d));
+        }
+        default:
+            return rng.next_double();
+    }
+}
+
+sample_2d sampler::get_2d() {
+    uint32_t d = dimension;
+    dimension += 2;
+    switch (type) {
+        case sampler_type::stratified: {
+            // nx * ny个格子，不少于每像素的采样数
+            uint32_t nx = std::max(1u, static_cast<uint32_t>(std::sqrt(static_cast<double>(strata))));
+            uint32_t ny = (strata + nx - 1) / nx;
+            uint32_t seed = dimension_seed(d);
+            uint32_t cell = permute_index(index % (nx * ny), nx * ny, seed);
+            uint32_t jitter = hash_bits(seed, index);
+            return {(cell % nx + to_unit(jitter << 16)) / nx, (cell / nx + to_unit(jitter & 0xffff0000u)) / ny};
+        }
+        case sampler_type::sobol:
+        case sampler_type::blue_noise: {
+            uint32_t x, y;
+            scrambled_sobol_2d(index, dimension_seed(d), x, y);
+            if (type == sampler_type::sobol)
+                return {to_unit(x), to_unit(y)};
+            return {wrap(to_unit(x) + blue_noise_shift(d)), wrap(to_unit(y) + blue_noise_shift(d + 1))};
+        }
+        default: {
+            double u = rng.next_double();
+            return {u, rng.next_double()};
+        }
+    }
+}
+
+// 把均匀分布的采样直接映射到需要的区域上，不用拒绝采样：每个采样恰好用掉固定的维数，
+// 低差异序列的分层性也保留到映射之后
+
+// 单位圆盘上均匀分布的点(Shirley-Chiu同心映射)，z = 0
+inline vec3 sample_unit_disk(sample_2d s) {
+    double a = 2 * s.u - 1, b = 2 * s.v - 1;
+    if (a == 0 && b == 0)
+        return vec3(0, 0, 0);
+    double r, theta;
+    if (std::fabs(a) > std::fabs(b)) {
+        r = a;
+        theta = (pi / 4) * (b / a);
+    } else {
+        r = b;
+        theta = (pi / 2) - (pi / 4) * (a / b);
+    }
+    return vec3(r * std::cos(theta), r * std::sin(theta), 0);
+}
+
+// 单位球面上均匀分布的方向
+inline vec3 sample_unit_vector(sample_2d s) {
+    double z = 1 - 2 * s.u;
+    double r = std::sqrt(std::max(0.0, 1 - z * z));
+    double phi = 2 * pi * s.v;
+    return vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+// 单位球内均匀分布的点：球面上的方向乘以按体积分布的半径
+inline vec3 sample_in_unit_sphere(sample_2d s, double radius_sample) {
+    return std::cbrt(radius_sample) * sample_unit_vector(s);
+}
+
+// z >= 0的半球上按cos加权分布的方向，pdf = cos / pi：把圆盘上的均匀点投影到半球上(Malley方法)
+inline vec3 sample_cosine_hemisphere(sample_2d s) {
+    vec3 d = sample_unit_disk(s);
+    double z = std::sqrt(std::max(0.0, 1.0 - d.x() * d.x() - d.y() * d.y()));
+    return vec3(d.x(), d.y(), z);
+}
+
+// 以单位向量n为z轴的正交基(Duff et al. 2017)，没有分支也没有除零
+inline void orthonormal_basis(const vec3 &n, vec3 &b1, vec3 &b2) {
+    double sign = std::copysign(1.0, static_cast<double>(n.z()));
+    double a = -1.0 / (sign + n.z());
+    double b = n.x() * n.y() * a;
+    b1 = vec3(1.0 + sign * n.x() * n.x() * a, sign * b, -sign * n.x());
+    b2 = vec3(b, sign + n.y() * n.y() * a, -n.y());
+}
+
+// 把以n为z轴的局部方向变换到世界坐标
+inline vec3 from_local(const vec3 &n, const vec3 &local) {
+    vec3 b1, b2;
+    orthonormal_basis(n, b1, b2);
+    return local.x() * b1 + local.y() * b2 + local.z() * n;
+}
+
+#endif
@@ -0,0 +1,673 @@
+#pragma once
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include "rtweekend.h"
+#include "hittable_list.h"
+#include "sphere.h"
+#include "moving_sphere.h"
+#include "material.h"
+#include "compiled_scene.h"
+#include "triangle_mesh.h"
+#include "cube.h"
+#include "instance.h"
+#include "image_writer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// 场景文件。
+//
+// 文本格式用于手写场景，每行一条记录，#之后是注释：
+//   material <名字> lambertian <r> <g> <b>
+//   material <名字> metal <r> <g> <b> <fuzz>
+//   material <名字> dielectric <折射率>
+//   material <名字> light <r> <g> <b>          发光材质，使用它的静止球是直接光照采样的光源
+//   background <r> <g> <b>                     没有击中物体的光线的颜色，不写时是天空的渐变色
+//   sphere <x> <y> <z> <半径> <材质名字> [velocity <vx> <vy> <vz>]   有velocity时是运动的球，(x, y, z)是第0秒的中心
+//   mesh <OBJ文件> <材质名字> [变换...]       同一个OBJ文件只读取一次，多个mesh共享顶点缓冲区和BVH
+//   box <x0> <y0> <z0> <x1> <y1> <z1> <材质名字> [变换...]
+// 变换按书写顺序依次作用在物体上：
+//   rotate <ax> <ay> <az> <角度>   translate <x> <y> <z>   scale <x> <y> <z>
+// 重复出现的物体先定义成原型，再用实例引用，原型的几何体和BVH只保存一份：
+//   object <原型名字>                        到end为止的sphere/box/mesh/instance属于这个原型
+//   end
+//   instance <原型名字> [变换...]
+//
+// 二进制格式(.rtscene)用于渲染，直接映射到内存使用，不为每个球分配对象：
+//   scene_file_header
+//   材质表    material_count 个 scene_file_material
+//   球体      center_x、center_y、center_z、radius 四个real数组(double，float构建时为float)，
+//             各有 sphere_count + sphere_simd_padding 个元素(末尾为0)，可直接交给SIMD内核
+//   材质下标  sphere_count 个 uint32
+//   BVH      node_count 个 flat_bvh_node，可以没有(node_count为0，加载时再建树)
+// 每一段都从64字节边界开始，数据使用主机字节序。
+
+// 球体数组保存为real，double和float的构建使用不同的文件标识，不能互相读取
+#ifdef RT_USE_FLOAT
+const char scene_file_magic[8] = {'R', 'T', 'S', 'C', 'E', 'N', 'F', '1'};
+#else
+const char scene_file_magic[8] = {'R', 'T', 'S', 'C', 'E', 'N', 'E', '1'};
+#endif
+
+struct scene_file_header {
+    char magic[8];
+    uint64_t sphere_count;
+    uint64_t material_count;
+    uint64_t node_count;
+    // 各段相对文件开头的字节偏移
+    uint64_t material_offset;
+    uint64_t center_x_offset, center_y_offset, center_z_offset, radius_offset;
+    uint64_t material_index_offset;
+    uint64_t node_offset;
+};
+
+enum scene_material_type : uint32_t {
+    scene_material_lambertian = 0,
+    scene_material_metal = 1,
+    scene_material_dielectric = 2,
+    scene_material_light = 3,
+};
+
+struct scene_file_material {
+    uint32_t type;
+    uint32_t pad;
+    // light: 发出的光
+    double albedo[3];
+    // metal: fuzz，dielectric: 折射率
+    double param;
+};
+
+static_assert(sizeof(scene_file_material) == 40, "scene_file_material must stay 40 bytes");
+
+// 只读映射整个文件
+class mapped_file {
+public:
+    mapped_file() {}
+
+    mapped_file(const mapped_file &) = delete;
+
+    mapped_file &operator=(const mapped_file &) = delete;
+
+    ~mapped_file() { close(); }
+
+    bool open(const std::string &path);
+
+    void close();
+
+    const unsigned char *data() const { return bytes; }
+
+    size_t size() const { return length; }
+
+private:
+    const unsigned char *bytes = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+};
+
+#ifdef _WIN32
+
+bool mapped_file::open(const std::string &path) {
+    close();
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                       FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+        close();
+        return false;
+    }
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        close();
+        return false;
+    }
+    bytes = static_cast<const unsigned char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!bytes) {
+        close();
+        return false;
+    }
+    length = static_cast<size_t>(file_size.QuadPart);
+    return true;
+}
+
+void mapped_file::close() {
+    if (bytes)
+        UnmapViewOfFile(bytes);
+    if (mapping)
+        CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE)
+        CloseHandle(file);
+    bytes = nullptr;
+    length = 0;
+    mapping = nullptr;
+    file = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+bool mapped_file::open(const std::string &path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void *address = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // 映射建立后文件描述符就不再需要了
+    ::close(fd);
+    if (address == MAP_FAILED)
+        return false;
+    bytes = static_cast<const unsigned char *>(address);
+    length = static_cast<size_t>(info.st_size);
+    return true;
+}
+
+void mapped_file::close() {
+    if (bytes)
+        munmap(const_cast<unsigned char *>(bytes), length);
+    bytes = nullptr;
+    length = 0;
+}
+
+#endif
+
+// ---------------------------------------------------------------------------
+// 文本格式
+
+// 读取行末的变换，无法解析时返回false
+bool read_scene_transform(std::istream &fields, affine_transform &to_world) {
+    std::string op;
+    while (fields >> op) {
+        double x, y, z, degrees;
+        if (op == "rotate" && fields >> x >> y >> z >> degrees)
+            to_world = affine_transform::rotate(vec3(x, y, z), degrees) * to_world;
+        else if (op == "translate" && fields >> x >> y >> z)
+            to_world = affine_transform::translate(vec3(x, y, z)) * to_world;
+        else if (op == "scale" && fields >> x >> y >> z && x != 0 && y != 0 && z != 0)
+            to_world = affine_transform::scale(vec3(x, y, z)) * to_world;
+        else
+            return false;
+    }
+    return true;
+}
+
+// 读取行末的变换，有变换时把object包装成instance
+bool read_scene_transform(std::istream &fields, shared_ptr<hittable> &object) {
+    if ((fields >> std::ws).eof())
+        return true;
+    affine_transform to_world;
+    if (!read_scene_transform(fields, to_world))
+        return false;
+    object = make_shared<instance>(object, to_world);
+    return true;
+}
+
+// 原型按isa编译
+bool read_scene_text(const std::string &path, hittable_list &world, scene_background &background, simd_isa isa) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "cannot open scene " << path << "\n";
+        return false;
+    }
+
+    std::unordered_map<std::string, shared_ptr<material>> materials;
+    std::unordered_map<std::string, shared_ptr<mesh_data>> meshes;
+    std::unordered_map<std::string, shared_ptr<hittable>> prototypes;
+    // 正在定义的原型，物体加入target
+    std::string prototype_name;
+    hittable_list prototype_objects;
+    hittable_list *target = &world;
+    std::string line;
+    int line_number = 0;
+    while (std::getline(in, line)) {
+        ++line_number;
+        std::istringstream fields(line.substr(0, line.find('#')));
+        std::string kind;
+        if (!(fields >> kind))
+            continue;
+
+        bool ok = false;
+        if (kind == "material") {
+            std::string name, type;
+            double r, g, b, param;
+            if (fields >> name >> type) {
+                if (type == "lambertian" && fields >> r >> g >> b) {
+                    materials[name] = make_shared<lambertian>(color(r, g, b));
+                    ok = true;
+                } else if (type == "metal" && fields >> r >> g >> b >> param) {
+                    materials[name] = make_shared<metal>(color(r, g, b), param);
+                    ok = true;
+                } else if (type == "dielectric" && fields >> param) {
+                    materials[name] = make_shared<dielectric>(param);
+                    ok = true;
+                } else if (type == "light" && fields >> r >> g >> b) {
+                    materials[name] = make_shared<diffuse_light>(color(r, g, b));
+                    ok = true;
+                }
+            }
+        } else if (kind == "background") {
+            double r, g, b;
+            if (fields >> r >> g >> b) {
+                background.sky = false;
+                background.value = color(r, g, b);
+                ok = true;
+            }
+        } else if (kind == "sphere") {
+            double x, y, z, radius;
+            std::string name;
+            if (fields >> x >> y >> z >> radius >> name) {
+                auto found = materials.find(name);
+                if (found == materials.end()) {
+                    std::cerr << path << ":" << line_number << ": unknown material '" << name << "'\n";
+                    return false;
+                }
+                std::string option;
+                double vx, vy, vz;
+                point3 center(x, y, z);
+                if (!(fields >> option)) {
+                    target->add(make_shared<sphere>(center, radius, found->second));
+                    ok = true;
+                } else if (option == "velocity" && fields >> vx >> vy >> vz) {
+                    target->add(make_shared<moving_sphere>(center, center + vec3(vx, vy, vz), 0, 1, radius, found->second));
+                    ok = true;
+                }
+            }
+        } else if (kind == "mesh") {
+            std::string mesh_path, name;
+            if (fields >> mesh_path >> name) {
+                auto found = materials.find(name);
+                if (found == materials.end()) {
+                    std::cerr << path << ":" << line_number << ": unknown material '" << name << "'\n";
+                    return false;
+                }
+                shared_ptr<mesh_data> &mesh = meshes[mesh_path];
+                if (!mesh) {
+                    mesh = make_shared<mesh_data>();
+                    if (!load_obj(mesh_path, *mesh))
+                        return false;
+                    mesh->build_bvh();
+                    std::cerr << mesh_path << ": ";
+                    mesh->report(std::cerr);
+                }
+                shared_ptr<hittable> object = make_shared<triangle_mesh>(mesh, found->second);
+                ok = read_scene_transform(fields, object);
+                if (ok)
+                    target->add(object);
+            }
+        } else if (kind == "box") {
+            double x0, y0, z0, x1, y1, z1;
+            std::string name;
+            if (fields >> x0 >> y0 >> z0 >> x1 >> y1 >> z1 >> name) {
+                auto found = materials.find(name);
+                if (found == materials.end()) {
+                    std::cerr << path << ":" << line_number << ": unknown material '" << name << "'\n";
+                    return false;
+                }
+                shared_ptr<hittable> object = make_shared<cube>(point3(x0, y0, z0), point3(x1, y1, z1), found->second);
+                ok = read_scene_transform(fields, object);
+                if (ok)
+                    target->add(object);
+            }
+        } else if (kind == "object") {
+            ok = target == &world && fields >> prototype_name;
+            if (ok) {
+                prototype_objects.clear();
+                target = &prototype_objects;
+            }
+        } else if (kind == "end") {
+            ok = target != &world;
+            if (ok) {
+                // 原型编译成一棵独立的BVH，所有实例共享
+                prototypes[prototype_name] = make_shared<compiled_scene>(compile_scene(prototype_objects, isa));
+                target = &world;
+            }
+        } else if (kind == "instance") {
+            std::string name;
+            if (fields >> name) {
+                auto found = prototypes.find(name);
+                if (found == prototypes.end()) {
+                    std::cerr << path << ":" << line_number << ": unknown object '" << name << "'\n";
+                    return false;
+                }
+                affine_transform to_world;
+                ok = read_scene_transform(fields, to_world);
+                if (ok)
+                    target->add(make_shared<instance>(found->second, to_world));
+            }
+        }
+
+        if (!ok) {
+            std::cerr << path << ":" << line_number << ": cannot parse '" << line << "'\n";
+            return false;
+        }
+    }
+    if (target != &world) {
+        std::cerr << path << ": object '" << prototype_name << "' has no end\n";
+        return false;
+    }
+    return true;
+}
+
+// 材质转换为二进制记录，不支持的材质类型返回false
+bool make_scene_material(const material *mat, scene_file_material &record) {
+    std::memset(&record, 0, sizeof(record));
+    if (auto m = dynamic_cast<const lambertian *>(mat)) {
+        record.type = scene_material_lambertian;
+        for (int c = 0; c < 3; ++c)
+            record.albedo[c] = m->albedo[c];
+    } else if (auto m = dynamic_cast<const metal *>(mat)) {
+        record.type = scene_material_metal;
+        for (int c = 0; c < 3; ++c)
+            record.albedo[c] = m->albedo[c];
+        record.param = m->fuzz;
+    } else if (auto m = dynamic_cast<const dielectric *>(mat)) {
+        record.type = scene_material_dielectric;
+        record.param = m->ir;
+    } else if (auto m = dynamic_cast<const diffuse_light *>(mat)) {
+        record.type = scene_material_light;
+        for (int c = 0; c < 3; ++c)
+            record.albedo[c] = m->emit[c];
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool write_scene_text(const std::string &path, const compiled_scene &scene) {
+    std::ostringstream out;
+    out.precision(17);
+    if (!scene.background.sky)
+        out << "background " << scene.background.value.x() << ' ' << scene.background.value.y() << ' '
+            << scene.background.value.z() << "\n";
+    for (size_t m = 0; m < scene.materials.size(); ++m) {
+        scene_file_material record;
+        if (!make_scene_material(scene.materials[m], record)) {
+            std::cerr << "material " << m << " cannot be written to a scene file\n";
+            return false;
+        }
+        out << "material m" << m;
+        if (record.type == scene_material_dielectric) {
+            out << " dielectric " << record.param << "\n";
+            continue;
+        }
+        const char *type = record.type == scene_material_metal ? " metal "
+                         : record.type == scene_material_light ? " light " : " lambertian ";
+        out << type
+            << record.albedo[0] << ' ' << record.albedo[1] << ' ' << record.albedo[2];
+        if (record.type == scene_material_metal)
+            out << ' ' << record.param;
+        out << "\n";
+    }
+    for (size_t k = 0; k < scene.sphere_count(); ++k)
+        out << "sphere " << scene.center_x[k] << ' ' << scene.center_y[k] << ' ' << scene.center_z[k] << ' '
+            << scene.radius[k] << " m" << scene.material_index[k] << "\n";
+    // 运动的球写出第0秒的中心和速度
+    for (const sphere_motion &m : scene.moving)
+        out << "sphere " << m.center.x() << ' ' << m.center.y() << ' ' << m.center.z() << ' ' << m.radius
+            << " m" << m.material << " velocity " << m.velocity.x() << ' ' << m.velocity.y() << ' '
+            << m.velocity.z() << "\n";
+
+    std::string text = out.str();
+    return write_file_block(path, std::vector<unsigned char>(text.begin(), text.end()));
+}
+
+// ---------------------------------------------------------------------------
+// 二进制格式
+
+bool write_scene_binary(const std::string &path, const compiled_scene &scene) {
+    if (!scene.others.empty()) {
+        std::cerr << "only spheres can be written to a binary scene\n";
+        return false;
+    }
+    if (scene.animated()) {
+        std::cerr << "moving spheres cannot be written to a binary scene\n";
+        return false;
+    }
+    if (!scene.background.sky) {
+        std::cerr << "a background color cannot be written to a binary scene\n";
+        return false;
+    }
+
+    auto align = [](uint64_t offset) { return (offset + 63) / 64 * 64; };
+    uint64_t n = scene.sphere_count();
+    uint64_t padded = n + sphere_simd_padding;
+
+    scene_file_header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, scene_file_magic, sizeof(header.magic));
+    header.sphere_count = n;
+    header.material_count = scene.materials.size();
+    header.node_count = scene.bvh.node_count;
+    header.material_offset = align(sizeof(header));
+    header.center_x_offset = align(header.material_offset + header.material_count * sizeof(scene_file_material));
+    header.center_y_offset = align(header.center_x_offset + padded * sizeof(real));
+    header.center_z_offset = align(header.center_y_offset + padded * sizeof(real));
+    header.radius_offset = align(header.center_z_offset + padded * sizeof(real));
+    header.material_index_offset = align(header.radius_offset + padded * sizeof(real));
+    header.node_offset = align(header.material_index_offset + n * sizeof(uint32_t));
+    uint64_t file_size = header.node_offset + header.node_count * sizeof(flat_bvh_node);
+
+    std::vector<unsigned char> data(file_size, 0);
+    std::memcpy(data.data(), &header, sizeof(header));
+    for (size_t m = 0; m < scene.materials.size(); ++m) {
+        scene_file_material record;
+        if (!make_scene_material(scene.materials[m], record)) {
+            std::cerr << "material " << m << " cannot be written to a scene file\n";
+            return false;
+        }
+        std::memcpy(&data[header.material_offset + m * sizeof(record)], &record, sizeof(record));
+    }
+    // 内存中的数组末尾同样有 sphere_simd_padding 个0
+    std::memcpy(&data[header.center_x_offset], scene.center_x, padded * sizeof(real));
+    std::memcpy(&data[header.center_y_offset], scene.center_y, padded * sizeof(real));
+    std::memcpy(&data[header.center_z_offset], scene.center_z, padded * sizeof(real));
+    std::memcpy(&data[header.radius_offset], scene.radius, padded * sizeof(real));
+    if (n > 0)
+        std::memcpy(&data[header.material_index_offset], scene.material_index, n * sizeof(uint32_t));
+    if (header.node_count > 0)
+        std::memcpy(&data[header.node_offset], scene.bvh.node_data, header.node_count * sizeof(flat_bvh_node));
+
+    return write_file_block(path, data);
+}
+
+// 材质按类型放进几个数组里一次分配，而不是每个材质一个make_shared
+struct scene_material_storage {
+    std::vector<lambertian> lambertians;
+    std::vector<metal> metals;
+    std::vector<dielectric> dielectrics;
+    std::vector<diffuse_light> lights;
+};
+
+// 检查文件中的BVH：子节点和叶子引用的球都必须在范围内，树的深度不能超过遍历栈
+bool check_scene_bvh(const flat_bvh_node *nodes, uint64_t node_count, uint64_t sphere_count) {
+    // 子节点的下标总是大于父节点，顺序扫描一遍就能得到每个节点离根的最大深度。
+    // 内部节点的深度必须小于遍历栈的大小，否则遍历时栈会溢出
+    std::vector<uint8_t> depth(node_count, 0);
+    for (uint64_t k = 0; k < node_count; ++k) {
+        const flat_bvh_node &node = nodes[k];
+        if (node.count > 0) {
+            if (node.offset + static_cast<uint64_t>(node.count) > sphere_count)
+                return false;
+            continue;
+        }
+        if (node.offset <= k || node.offset >= node_count || node.axis > 2 || depth[k] >= flat_bvh_max_depth)
+            return false;
+        uint8_t child_depth = static_cast<uint8_t>(depth[k] + 1);
+        depth[k + 1] = std::max(depth[k + 1], child_depth);
+        depth[node.offset] = std::max(depth[node.offset], child_depth);
+    }
+    return true;
+}
+
+// 映射二进制场景文件，球体数组和BVH直接使用映射的内存
+bool load_scene_binary(const std::string &path, compiled_scene &scene, simd_isa isa) {
+    auto file = make_shared<mapped_file>();
+    if (!file->open(path)) {
+        std::cerr << "cannot map scene " << path << "\n";
+        return false;
+    }
+
+    const unsigned char *base = file->data();
+    scene_file_header header;
+    if (file->size() < sizeof(header)) {
+        std::cerr << path << " is not a scene file\n";
+        return false;
+    }
+    std::memcpy(&header, base, sizeof(header));
+    if (std::memcmp(header.magic, scene_file_magic, sizeof(header.magic)) != 0) {
+        if (std::memcmp(header.magic, scene_file_magic, 6) == 0)
+            std::cerr << path << " was written with a different floating point type\n";
+        else
+            std::cerr << path << " is not a scene file\n";
+        return false;
+    }
+
+    // 每一段都必须对齐并且完整地位于文件内
+    uint64_t padded = header.sphere_count + sphere_simd_padding;
+    auto section_ok = [&](uint64_t offset, uint64_t count, uint64_t element_size) {
+        return offset % 64 == 0 && offset <= file->size() &&
+               count <= (file->size() - offset) / element_size;
+    };
+    bool ok = header.sphere_count < UINT32_MAX && header.material_count < UINT32_MAX &&
+              section_ok(header.material_offset, header.material_count, sizeof(scene_file_material)) &&
+              section_ok(header.center_x_offset, padded, sizeof(real)) &&
+              section_ok(header.center_y_offset, padded, sizeof(real)) &&
+              section_ok(header.center_z_offset, padded, sizeof(real)) &&
+              section_ok(header.radius_offset, padded, sizeof(real)) &&
+              section_ok(header.material_index_offset, header.sphere_count, sizeof(uint32_t)) &&
+              section_ok(header.node_offset, header.node_count, sizeof(flat_bvh_node));
+    if (!ok) {
+        std::cerr << "scene " << path << " is truncated or corrupt\n";
+        return false;
+    }
+
+    // 材质
+    auto storage = make_shared<scene_material_storage>();
+    const auto *records = reinterpret_cast<const scene_file_material *>(base + header.material_offset);
+    for (uint64_t m = 0; m < header.material_count; ++m) {
+        const scene_file_material &record = records[m];
+        color albedo(record.albedo[0], record.albedo[1], record.albedo[2]);
+        if (record.type == scene_material_lambertian)
+            storage->lambertians.emplace_back(albedo);
+        else if (record.type == scene_material_metal)
+            storage->metals.emplace_back(albedo, record.param);
+        else if (record.type == scene_material_dielectric)
+            storage->dielectrics.emplace_back(record.param);
+        else if (record.type == scene_material_light)
+            storage->lights.emplace_back(albedo);
+        else {
+            std::cerr << "scene " << path << ": unknown material type " << record.type << "\n";
+            return false;
+        }
+    }
+    // 几个vector都不再增长之后才取元素的地址
+    size_t next[4] = {0, 0, 0, 0};
+    scene.materials.clear();
+    for (uint64_t m = 0; m < header.material_count; ++m) {
+        switch (records[m].type) {
+            case scene_material_lambertian:
+                scene.materials.push_back(&storage->lambertians[next[0]++]);
+                break;
+            case scene_material_metal:
+                scene.materials.push_back(&storage->metals[next[1]++]);
+                break;
+            case scene_material_light:
+                scene.materials.push_back(&storage->lights[next[3]++]);
+                break;
+            default:
+                scene.materials.push_back(&storage->dielectrics[next[2]++]);
+                break;
+        }
+    }
+
+    const auto *material_index = reinterpret_cast<const uint32_t *>(base + header.material_index_offset);
+    for (uint64_t k = 0; k < header.sphere_count; ++k) {
+        if (material_index[k] >= header.material_count) {
+            std::cerr << "scene " << path << ": sphere " << k << " has an invalid material\n";
+            return false;
+        }
+    }
+
+    scene.count = header.sphere_count;
+    scene.center_x = reinterpret_cast<const real *>(base + header.center_x_offset);
+    scene.center_y = reinterpret_cast<const real *>(base + header.center_y_offset);
+    scene.center_z = reinterpret_cast<const real *>(base + header.center_z_offset);
+    scene.radius = reinterpret_cast<const real *>(base + header.radius_offset);
+    scene.material_index = material_index;
+    scene.owners.push_back(storage);
+    scene.owners.push_back(file);
+    scene.others.clear();
+    scene.others_bvh.attach(nullptr, 0);
+
+    if (header.node_count > 0) {
+        const auto *nodes = reinterpret_cast<const flat_bvh_node *>(base + header.node_offset);
+        if (!check_scene_bvh(nodes, header.node_count, header.sphere_count)) {
+            std::cerr << "scene " << path << ": invalid bvh\n";
+            return false;
+        }
+        scene.bvh.attach(nodes, header.node_count);
+    } else if (header.sphere_count > 0) {
+        // 文件里没有BVH：建树并按叶子顺序复制一份球体数据
+        std::vector<bvh_build_item> items(header.sphere_count);
+        for (uint64_t k = 0; k < header.sphere_count; ++k) {
+            real r = fabs(scene.radius[k]);
+            point3 center(scene.center_x[k], scene.center_y[k], scene.center_z[k]);
+            aabb box(center - vec3(r, r, r), center + vec3(r, r, r));
+            items[k] = {box, center, k};
+        }
+        scene.bvh.build(items, sphere_simd_max_width, simd_isa_width(std::min(isa, detect_simd_isa())));
+
+        size_t n = scene.bvh.order.size();
+        size_t stride = n + sphere_simd_padding;
+        auto arrays = make_shared<std::vector<real>>(4 * stride, real(0));
+        auto indices = make_shared<std::vector<uint32_t>>(n);
+        real *out = arrays->data();
+        const real *in[4] = {scene.center_x, scene.center_y, scene.center_z, scene.radius};
+        for (size_t k = 0; k < n; ++k) {
+            uint32_t from = scene.bvh.order[k];
+            for (int a = 0; a < 4; ++a)
+                out[a * stride + k] = in[a][from];
+            (*indices)[k] = material_index[from];
+        }
+        scene.center_x = out;
+        scene.center_y = out + stride;
+        scene.center_z = out + 2 * stride;
+        scene.radius = out + 3 * stride;
+        scene.material_index = indices->data();
+        scene.owners.push_back(arrays);
+        scene.owners.push_back(indices);
+    }
+
+    scene.build_lights();
+    scene.set_simd(isa);
+    return true;
+}
+
+#endif
@@ -0,0 +1,264 @@
+#pragma once
+#ifndef SCENES_H
+#define SCENES_H
+
+#include "rtweekend.h"
+
+#include "hittable_list.h"
+#include "sphere.h"
+#include "moving_sphere.h"
+#include "material.h"
+#include "cube.h"
+#include "instance.h"
+#include "compiled_scene.h"
+
+#include <string>
+#include <vector>
+
+// 内置的场景。场景里的随机数来自当前线程的生成器，构建前先把它恢复到默认状态，
+// 这样同一个场景不论在什么时候构建都完全相同。
+
+// 书中最后的封面场景：大量随机的小球加三个大球
+hittable_list random_scene() {
+    hittable_list world;
+    thread_rng() = pcg32();
+
+    auto ground_material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+    world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, ground_material));
+
+    for (int a = -11; a < 11; a++) {
+        for (int b = -11; b < 11; b++) {
+            auto choose_mat = random_double();
+            point3 center(a + 0.9 * random_double(), 0.2, b + 0.9 * random_double());
+
+            if ((center - point3(4, 0.2, 0)).length() > 0.9) {
+                shared_ptr<material> sphere_material;
+
+                if (choose_mat < 0.8) {
+                    // diffuse
+                    auto albedo = color::random() * color::random();
+                    sphere_material = make_shared<lambertian>(albedo);
+                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
+                } else if (choose_mat < 0.95) {
+                    // metal
+                    auto albedo = color::random(0.5, 1);
+                    auto fuzz = random_double(0, 0.5);
+                    sphere_material = make_shared<metal>(albedo, fuzz);
+                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
+                } else {
+                    // glass
+                    sphere_material = make_shared<dielectric>(1.5);
+                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
+                }
+            }
+        }
+    }
+
+    auto material1 = make_shared<dielectric>(1.5);
+    world.add(make_shared<sphere>(point3(0, 1, 0), 1.0, material1));
+
+    auto material2 = make_shared<lambertian>(color(0.4, 0.2, 0.1));
+    world.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, material2));
+
+    auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
+    world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
+
+    return world;
+}
+
+// Chapter Listing 59：地面、漫反射球、空心玻璃球、金属球
+hittable_list three_spheres_scene() {
+    hittable_list world;
+
+    shared_ptr<lambertian> material_ground = make_shared<lambertian>(color(0.8, 0.8, 0.0));
+    shared_ptr<lambertian> material_center = make_shared<lambertian>(color(0.1, 0.2, 0.5));
+    shared_ptr<dielectric> material_left = make_shared<dielectric>(1.5);
+    shared_ptr<metal> material_right = make_shared<metal>(color(0.8, 0.6, 0.2), 0.0);
+
+    world.add(make_shared<sphere>(point3(0.0, -100.5, -1.0), 100.0, material_ground));
+    world.add(make_shared<sphere>(point3(0.0, 0.0, -1.0), 0.5, material_center));
+    world.add(make_shared<sphere>(point3(-1.0, 0.0, -1.0), 0.5, material_left));
+    world.add(make_shared<sphere>(point3(-1.0, 0.0, -1.0), -0.4, material_left));
+    world.add(make_shared<sphere>(point3(1.0, 0.0, -1.0), 0.5, material_right));
+
+    return world;
+}
+
+// 由长方体组成的街区：地面上是高度随机的楼，一部分绕y轴转过一个角度
+hittable_list boxes_scene() {
+    hittable_list world;
+    thread_rng() = pcg32();
+
+    auto ground_material = make_shared<lambertian>(color(0.48, 0.83, 0.53));
+    world.add(make_shared<cube>(point3(-30, -1, -30), point3(30, 0, 30), ground_material));
+
+    auto wall = make_shared<lambertian>(color(0.8, 0.8, 0.75));
+    auto glass = make_shared<metal>(color(0.6, 0.7, 0.8), 0.05);
+    for (int a = -10; a < 10; a++) {
+        for (int b = -10; b < 10; b++) {
+            double width = random_double(0.6, 1.6);
+            double height = random_double(0.5, 6.0);
+            point3 base(a * 2.5 + 1.25, 0, b * 2.5 + 1.25);
+            shared_ptr<material> mat = random_double() < 0.3 ? shared_ptr<material>(glass) : wall;
+            shared_ptr<hittable> building = make_shared<cube>(point3(-width / 2, 0, -width / 2),
+                                                              point3(width / 2, height, width / 2), mat);
+            affine_transform place = affine_transform::translate(base);
+            if (random_double() < 0.4)
+                place = place * affine_transform::rotate(vec3(0, 1, 0), random_double(0, 90));
+            world.add(make_shared<instance>(building, place));
+        }
+    }
+
+    return world;
+}
+
+// 树林：同一棵树(树干是长方体，树冠是一簇球)作为原型，实例化成一万棵大小和朝向不同的树。
+// 原型只编译一次，每个实例只有一个变换
+hittable_list forest_scene(simd_isa isa) {
+    hittable_list world;
+    thread_rng() = pcg32();
+
+    auto ground_material = make_shared<lambertian>(color(0.45, 0.4, 0.3));
+    world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, ground_material));
+
+    hittable_list tree;
+    auto bark = make_shared<lambertian>(color(0.35, 0.22, 0.12));
+    auto leaves = make_shared<lambertian>(color(0.15, 0.45, 0.12));
+    tree.add(make_shared<cube>(point3(-0.08, 0, -0.08), point3(0.08, 1.0, 0.08), bark));
+    for (int k = 0; k < 40; ++k) {
+        vec3 offset = random_in_unit_sphere();
+        tree.add(make_shared<sphere>(point3(0, 1.3, 0) + 0.45 * offset, random_double(0.15, 0.3), leaves));
+    }
+    shared_ptr<hittable> prototype = make_shared<compiled_scene>(compile_scene(tree, isa));
+
+    for (int a = -50; a < 50; a++) {
+        for (int b = -50; b < 50; b++) {
+            point3 position(a * 1.2 + random_double(0, 0.8), 0, b * 1.2 + random_double(0, 0.8));
+            double size = random_double(0.6, 1.4);
+            affine_transform place = affine_transform::translate(position) *
+                                     affine_transform::rotate(vec3(0, 1, 0), random_double(0, 360)) *
+                                     affine_transform::scale(vec3(size, size, size));
+            world.add(make_shared<instance>(prototype, place));
+        }
+    }
+
+    return world;
+}
+
+// 放大的封面场景：地面上(2 * half_extent)^2个随机材质的小球，用来测试大场景的BVH与求交
+hittable_list sphere_field_scene(int half_extent) {
+    hittable_list world;
+    thread_rng() = pcg32();
+
+    auto ground_material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+    world.add(make_shared<sphere>(point3(0, -10000, 0), 10000, ground_material));
+
+    // 材质的种类有限，所有小球共用同一组材质
+    std::vector<shared_ptr<material>> palette;
+    for (int k = 0; k < 32; ++k)
+        palette.push_back(make_shared<lambertian>(color::random() * color::random()));
+    for (int k = 0; k < 8; ++k)
+        palette.push_back(make_shared<metal>(color::random(0.5, 1), random_double(0, 0.5)));
+    palette.push_back(make_shared<dielectric>(1.5));
+
+    for (int a = -half_extent; a < half_extent; a++) {
+        for (int b = -half_extent; b < half_extent; b++) {
+            point3 center(a + 0.9 * random_double(), 0.2, b + 0.9 * random_double());
+            auto choose_mat = random_double();
+            size_t index = choose_mat < 0.8 ? static_cast<size_t>(choose_mat / 0.8 * 32)
+                         : choose_mat < 0.95 ? 32 + static_cast<size_t>((choose_mat - 0.8) / 0.15 * 8)
+                         : 40;
+            world.add(make_shared<sphere>(center, 0.2, palette[index]));
+        }
+    }
+
+    return world;
+}
+
+// 小光源场景：没有天空，只由几个小而亮的发光球照明。只靠BSDF采样的路径很少碰到光源，
+// 需要直接光照才能在合理的采样数内收敛
+hittable_list small_lights_scene() {
+    hittable_list world;
+    thread_rng() = pcg32();
+
+    auto ground_material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+    world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, ground_material));
+
+    world.add(make_shared<sphere>(point3(0, 1, 0), 1.0, make_shared<dielectric>(1.5)));
+    world.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, make_shared<lambertian>(color(0.4, 0.2, 0.1))));
+    world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, make_shared<metal>(color(0.7, 0.6, 0.5), 0.0)));
+
+    // 地面上的漫反射小球
+    for (int a = -8; a < 8; a++) {
+        for (int b = -8; b < 8; b++) {
+            point3 center(a + 0.9 * random_double(), 0.2, b + 0.9 * random_double());
+            if ((center - point3(4, 0.2, 0)).length() > 0.9 && (center - point3(-4, 0.2, 0)).length() > 0.9 &&
+                (center - point3(0, 0.2, 0)).length() > 0.9)
+                world.add(make_shared<sphere>(center, 0.2, make_shared<lambertian>(color::random() * color::random())));
+        }
+    }
+
+    // 一个暖色的主光源和一圈彩色的小灯
+    world.add(make_shared<sphere>(point3(-2, 4, 3), 0.25, make_shared<diffuse_light>(color(60, 50, 40))));
+    for (int k = 0; k < 12; ++k) {
+        double angle = 2 * pi * k / 12;
+        point3 center(6 * std::cos(angle), 0.6, 6 * std::sin(angle));
+        color emit = color::random(0.2, 1) * 25;
+        world.add(make_shared<sphere>(center, 0.08, make_shared<diffuse_light>(emit)));
+    }
+
+    return world;
+}
+
+// 旋转木马：底座和一个运动的球组成原型，绕圈放置八个实例。原型里的运动在各个实例中朝不同的方向，
+// 用来检查动画和运动模糊时实例的包围盒是否随原型更新
+hittable_list carousel_scene(simd_isa isa) {
+    hittable_list world;
+
+    auto ground_material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+    world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, ground_material));
+
+    hittable_list cart;
+    cart.add(make_shared<cube>(point3(-0.6, 0, -0.4), point3(0.6, 0.3, 0.4),
+                               make_shared<lambertian>(color(0.6, 0.3, 0.1))));
+    // 第0秒在底座上方，每秒沿x移动1.5
+    cart.add(make_shared<moving_sphere>(point3(0, 0.8, 0), point3(1.5, 0.8, 0), 0, 1, 0.4,
+                                        make_shared<metal>(color(0.8, 0.8, 0.9), 0.1)));
+    shared_ptr<hittable> prototype = make_shared<compiled_scene>(compile_scene(cart, isa));
+
+    for (int k = 0; k < 8; ++k) {
+        double angle = 360.0 * k / 8;
+        affine_transform place = affine_transform::rotate(vec3(0, 1, 0), angle) *
+                                 affine_transform::translate(vec3(5, 0, 0));
+        world.add(make_shared<instance>(prototype, place));
+    }
+    world.add(make_shared<sphere>(point3(0, 1, 0), 1.0, make_shared<dielectric>(1.5)));
+
+    return world;
+}
+
+// 按名字构建场景，名字未知时返回false。场景自己决定背景，没有设置时保持天空。
+// 场景中的原型按isa编译
+bool make_scene(const std::string &name, hittable_list &world, scene_background &background, simd_isa isa) {
+    if (name == "random")
+        world = random_scene();
+    else if (name == "three_spheres")
+        world = three_spheres_scene();
+    else if (name == "boxes")
+        world = boxes_scene();
+    else if (name == "forest")
+        world = forest_scene(isa);
+    else if (name == "spheres")
+        world = sphere_field_scene(158);
+    else if (name == "carousel")
+        world = carousel_scene(isa);
+    else if (name == "small_lights") {
+        world = small_lights_scene();
+        background.sky = false;
+        background.value = color(0, 0, 0);
+    } else
+        return false;
+    return true;
+}
+
+#endif
@@ -0,0 +1,355 @@
+#pragma once
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include "rtweekend.h"
+#include "sphere_simd.h"
+#include "animation.h"
+#include "sampler.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// 一次渲染任务(job)的全部参数，运行时从设置文件和命令行读取，不需要重新编译
+struct render_settings {
+    // 场景与相机。scene是内置场景的名字或场景文件，设置export_scene时只保存场景而不渲染
+    std::string scene = "random";
+    std::string export_scene;
+    point3 lookfrom = point3(13, 2, 3);
+    point3 lookat = point3(0, 0, 0);
+    vec3 vup = vec3(0, 1, 0);
+    double vfov = 20;
+    double aperture = 0.1;
+    double focus_dist = 10.0;
+
+    // 图像
+    int image_width = 1600;
+    double aspect_ratio = 16.0 / 9.0;
+
+    // 采样
+    int samples_per_pixel = 60;
+    int pass_samples = 8;
+    int min_samples = 16;
+    double adaptive_threshold = 0;
+    int max_depth = 50;
+    int rr_depth = 5;
+    // path逐条追踪路径，wavefront把一个tile的路径整批按弹射同步推进，两者结果相同
+    std::string integrator = "path";
+    // 像素、镜头和每次弹射的随机数来源：independent|stratified|sobol|blue-noise
+    std::string sampler = "sobol";
+    uint64_t seed = 0;
+
+    // 运行
+    int threads = 0;
+    std::string simd;
+    // 在标准错误上显示剩余的tile数
+    bool progress = true;
+
+    // 输出
+    std::string output = "-";
+    std::string heatmap;
+    // 每个tile渲染耗时的热力图，PFM中保存秒数
+    std::string tile_heatmap;
+    // 参考图(PFM)，渲染结束后输出与它的均方根误差
+    std::string reference;
+    std::string checkpoint;
+    double checkpoint_interval = 60;
+    bool resume = false;
+
+    // 动画：渲染第first_frame到last_frame帧(包括两端)，last_frame < first_frame时只渲染一张图。
+    // 第f帧是第f / fps秒，运动的球按这个时间移动
+    int first_frame = 0;
+    int last_frame = -1;
+    double fps = 24;
+    // 相机关键帧，按帧号排序，相邻关键帧之间用样条插值；没有关键帧时相机固定在lookfrom/lookat
+    std::vector<camera_keyframe> keyframes;
+    // 整段动画中相机绕经过lookat的vup轴转过的角度，360就是一圈转台
+    double turntable = 0;
+    // 图像的时刻(秒)，动画中由帧号计算。快门从这一时刻打开，持续shutter帧(0.5相当于180度快门)，
+    // 运动的物体在快门期间的位置合起来形成运动模糊；0表示不模糊
+    double time = 0;
+    double shutter = 0;
+
+    int image_height() const { return static_cast<int>(image_width / aspect_ratio); }
+
+    // 设置的指令集，没有设置时为CPU支持的最宽的指令集；场景的叶子宽度和求交内核都按它选择
+    simd_isa simd_isa_or_detected() const {
+        simd_isa isa = detect_simd_isa();
+        if (!simd.empty())
+            parse_simd_isa(simd.c_str(), isa);
+        return isa;
+    }
+
+    bool animated() const { return last_frame >= first_frame; }
+};
+
+// 设置项以 key=value 的形式出现，键名与命令行选项相同(去掉"--")
+typedef std::vector<std::pair<std::string, std::string>> setting_list;
+
+// 场景的默认相机。make_job_settings在应用任何设置之前先按最终的场景设置它，
+// 所以不论scene出现在哪一层、哪个位置，用户的相机设置都不会被覆盖
+void apply_scene_camera(render_settings &s) {
+    if (s.scene == "three_spheres") {
+        s.lookfrom = point3(3, 3, 2);
+        s.lookat = point3(0, 0, -1);
+        s.vfov = 20;
+        s.aperture = 0;
+        s.focus_dist = (s.lookfrom - s.lookat).length();
+    } else if (s.scene == "carousel") {
+        s.lookfrom = point3(0, 9, 15);
+        s.lookat = point3(0, 0.5, 0);
+        s.vfov = 40;
+        s.aperture = 0;
+        s.focus_dist = (s.lookfrom - s.lookat).length();
+    } else if (s.scene == "forest") {
+        s.lookfrom = point3(0, 6, 62);
+        s.lookat = point3(0, 0, 30);
+        s.vfov = 40;
+        s.aperture = 0;
+        s.focus_dist = (s.lookfrom - s.lookat).length();
+    } else if (s.scene == "spheres") {
+        s.lookfrom = point3(40, 12, 40);
+        s.lookat = point3(0, 0, 0);
+        s.vfov = 35;
+        s.aperture = 0;
+        s.focus_dist = (s.lookfrom - s.lookat).length();
+    } else if (s.scene == "boxes") {
+        s.lookfrom = point3(28, 14, 22);
+        s.lookat = point3(0, 1, 0);
+        s.vfov = 35;
+        s.aperture = 0;
+        s.focus_dist = (s.lookfrom - s.lookat).length();
+    } else {
+        s.lookfrom = point3(13, 2, 3);
+        s.lookat = point3(0, 0, 0);
+        s.vfov = 20;
+        s.aperture = 0.1;
+        s.focus_dist = 10.0;
+    }
+    s.vup = vec3(0, 1, 0);
+}
+
+// 解析"x,y,z"或"x y z"
+bool parse_vec3(const std::string &value, vec3 &v) {
+    std::string text = value;
+    for (char &c : text)
+        if (c == ',')
+            c = ' ';
+    std::istringstream in(text);
+    double x, y, z;
+    if (!(in >> x >> y >> z))
+        return false;
+    v = vec3(x, y, z);
+    return true;
+}
+
+// 解析"frame x,y,z x,y,z"：帧号、相机位置和注视点
+bool parse_camera_keyframe(const std::string &value, camera_keyframe &key) {
+    std::istringstream in(value);
+    std::string lookfrom, lookat, rest;
+    return in >> key.frame >> lookfrom >> lookat && !(in >> rest) &&
+           parse_vec3(lookfrom, key.lookfrom) && parse_vec3(lookat, key.lookat);
+}
+
+// 修改一个设置项，键名未知或值无法解析时打印错误并返回false
+bool apply_setting(render_settings &s, const std::string &key, const std::string &value) {
+    const char *text = value.c_str();
+    char *end = nullptr;
+    bool ok = true;
+
+    auto as_int = [&](int &out, int min_value) {
+        long v = std::strtol(text, &end, 10);
+        ok = end != text && *end == '\0';
+        out = std::max(min_value, static_cast<int>(v));
+    };
+    auto as_double = [&](double &out) {
+        double v = std::strtod(text, &end);
+        ok = end != text && *end == '\0';
+        out = v;
+    };
+
+    if (key == "scene") {
+        s.scene = value;
+    } else if (key == "export-scene") {
+        s.export_scene = value;
+    } else if (key == "lookfrom") {
+        ok = parse_vec3(value, s.lookfrom);
+    } else if (key == "lookat") {
+        ok = parse_vec3(value, s.lookat);
+    } else if (key == "vup") {
+        ok = parse_vec3(value, s.vup);
+    } else if (key == "vfov") {
+        as_double(s.vfov);
+    } else if (key == "aperture") {
+        as_double(s.aperture);
+    } else if (key == "focus-dist") {
+        as_double(s.focus_dist);
+    } else if (key == "width") {
+        as_int(s.image_width, 1);
+    } else if (key == "aspect") {
+        // 允许写成"16/9"
+        size_t slash = value.find('/');
+        if (slash != std::string::npos) {
+            double w = std::atof(value.substr(0, slash).c_str());
+            double h = std::atof(value.substr(slash + 1).c_str());
+            ok = w > 0 && h > 0;
+            if (ok)
+                s.aspect_ratio = w / h;
+        } else {
+            as_double(s.aspect_ratio);
+            ok = ok && s.aspect_ratio > 0;
+        }
+    } else if (key == "spp") {
+        as_int(s.samples_per_pixel, 1);
+    } else if (key == "pass-spp") {
+        as_int(s.pass_samples, 1);
+    } else if (key == "min-spp") {
+        as_int(s.min_samples, 2);
+    } else if (key == "adaptive") {
+        as_double(s.adaptive_threshold);
+    } else if (key == "max-depth") {
+        as_int(s.max_depth, 0);
+    } else if (key == "rr-depth") {
+        as_int(s.rr_depth, 0);
+    } else if (key == "integrator") {
+        ok = value == "path" || value == "wavefront";
+        s.integrator = value;
+    } else if (key == "sampler") {
+        sampler_type type;
+        ok = parse_sampler_type(text, type);
+        s.sampler = value;
+    } else if (key == "seed") {
+        s.seed = std::strtoull(text, &end, 10);
+        ok = end != text && *end == '\0';
+    } else if (key == "threads") {
+        as_int(s.threads, 0);
+    } else if (key == "simd") {
+        simd_isa isa;
+        ok = parse_simd_isa(text, isa);
+        s.simd = value;
+    } else if (key == "output") {
+        s.output = value;
+    } else if (key == "heatmap") {
+        s.heatmap = value;
+    } else if (key == "tile-heatmap") {
+        s.tile_heatmap = value;
+    } else if (key == "reference") {
+        s.reference = value;
+    } else if (key == "checkpoint") {
+        s.checkpoint = value;
+    } else if (key == "checkpoint-interval") {
+        as_double(s.checkpoint_interval);
+    } else if (key == "progress") {
+        s.progress = value != "0" && value != "false";
+    } else if (key == "resume") {
+        s.resume = value != "0" && value != "false";
+    } else if (key == "frames") {
+        // "first-last"，或者"N"表示第0到N-1帧
+        long first = 0, last = std::strtol(text, &end, 10) - 1;
+        if (end != text && *end == '-') {
+            first = last + 1;
+            const char *second = end + 1;
+            last = std::strtol(second, &end, 10);
+            ok = end != second;
+        } else {
+            ok = end != text;
+        }
+        ok = ok && *end == '\0' && first >= 0 && last >= first;
+        s.first_frame = static_cast<int>(first);
+        s.last_frame = static_cast<int>(last);
+    } else if (key == "fps") {
+        as_double(s.fps);
+        ok = ok && s.fps > 0;
+    } else if (key == "keyframe") {
+        // 可以出现多次，每次添加一个关键帧
+        camera_keyframe keyframe;
+        ok = parse_camera_keyframe(value, keyframe);
+        if (ok) {
+            auto later = std::upper_bound(s.keyframes.begin(), s.keyframes.end(), keyframe.frame,
+                                          [](int frame, const camera_keyframe &k) { return frame < k.frame; });
+            s.keyframes.insert(later, keyframe);
+        }
+    } else if (key == "turntable") {
+        as_double(s.turntable);
+    } else if (key == "time") {
+        as_double(s.time);
+    } else if (key == "shutter") {
+        as_double(s.shutter);
+        ok = ok && s.shutter >= 0;
+    } else {
+        std::cerr << "unknown setting '" << key << "'\n";
+        return false;
+    }
+
+    if (!ok)
+        std::cerr << "invalid value '" << value << "' for setting '" << key << "'\n";
+    return ok;
+}
+
+// 读取设置文件：
+//   # 注释
+//   key = value        出现在第一个[job]之前的设置对所有job生效
+//   [job]              开始一个新的job，之后的设置只对这个job生效
+// 没有[job]时整个文件描述一个job
+bool read_settings_file(const std::string &path, setting_list &common, std::vector<setting_list> &jobs) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "cannot open settings file " << path << "\n";
+        return false;
+    }
+
+    auto trim = [](const std::string &text) {
+        size_t first = text.find_first_not_of(" \t\r");
+        if (first == std::string::npos)
+            return std::string();
+        size_t last = text.find_last_not_of(" \t\r");
+        return text.substr(first, last - first + 1);
+    };
+
+    std::string line;
+    int line_number = 0;
+    while (std::getline(in, line)) {
+        ++line_number;
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty())
+            continue;
+        if (line == "[job]") {
+            jobs.emplace_back();
+            continue;
+        }
+        size_t equals = line.find('=');
+        if (equals == std::string::npos) {
+            std::cerr << path << ":" << line_number << ": expected key = value\n";
+            return false;
+        }
+        auto setting = std::make_pair(trim(line.substr(0, equals)), trim(line.substr(equals + 1)));
+        if (jobs.empty())
+            common.push_back(setting);
+        else
+            jobs.back().push_back(setting);
+    }
+    return true;
+}
+
+// 依次应用每一组设置，后面的覆盖前面的。最终场景的默认相机作为最底层，先于所有设置应用
+bool make_job_settings(const std::vector<const setting_list *> &layers, render_settings &s) {
+    s = render_settings();
+    for (const setting_list *layer : layers)
+        for (const auto &setting : *layer)
+            if (setting.first == "scene")
+                s.scene = setting.second;
+    apply_scene_camera(s);
+    for (const setting_list *layer : layers)
+        for (const auto &setting : *layer)
+            if (!apply_setting(s, setting.first, setting.second))
+                return false;
+    return true;
+}
+
+#endif
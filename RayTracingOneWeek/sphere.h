@@ -9,14 +9,18 @@ class sphere : public hittable {
 public:
     sphere() {}
 
-    sphere(point3 cen, double r, shared_ptr<material> m) : center(cen), radius(r), mat_ptr(m) {};
+    sphere(point3 cen, real r, shared_ptr<material> m) : center(cen), radius(r), mat_ptr(m) {};
 
     virtual bool hit(
-            const ray &r, double t_min, double t_max, hit_record &rec) const override;
+            const ray &r, real t_min, real t_max, hit_record &rec) const override;
+
+    virtual bool occluded(const ray &r, real t_min, real t_max) const override;
+
+    virtual bool bounding_box(aabb &output_box) const override;
 
 public:
     point3 center;
-    double radius;
+    real radius;
     shared_ptr<material> mat_ptr;
 };
 
@@ -50,7 +54,25 @@ return false;
 }
  *
  * */
-bool sphere::hit(const ray &r, double t_min, double t_max, hit_record &rec) const {
+// 由rec.t填写撞点、误差和法线。r.at(t)的误差随t的误差增长，所以把撞点沿径向投影回球面，
+// 误差只与球的大小和位置有关。投影的长度用1/r做一次牛顿迭代代替sqrt：|p - center|与|r|只差
+// 相对误差d，迭代后剩下约d^2的误差，一并计入rec.error
+inline void sphere_set_hit(const ray &r, const point3 &center, real radius, hit_record &rec) {
+    vec3 local = r.at(rec.t) - center;
+    real inv_radius = 1 / radius;
+    real d = local.length_squared() * inv_radius * inv_radius - 1;
+    // 半径为负时朝内，与 (p - center) / radius 相同
+    vec3 outward_normal = ((1 - real(0.5) * d) * inv_radius) * local;
+    rec.p = center + radius * outward_normal;
+    rec.error = error_gamma(6) * (std::fabs(radius) + max_abs(center)) + std::fabs(radius) * d * d;
+    // 表面法线方向一定与入射相反的
+    rec.set_face_normal(r, outward_normal);
+}
+
+// 光线与球求交，root是[t_min, t_max]内最近的交点
+inline bool sphere_intersect(const ray &r, const point3 &center, real radius, real t_min, real t_max, real &root) {
+    RT_STAT_ADD(primitive_tests, 1);
+    RT_STAT_ADD(sphere_tests, 1);
     // 求交
     vec3 oc = r.origin() - center;
     auto a = r.direction().length_squared();
@@ -62,28 +84,42 @@ bool sphere::hit(const ray &r, double t_min, double t_max, hit_record &rec) cons
     // 没根的情况下返回
     if (discriminant < 0)
         return false;
-    double sqrtd = sqrt(discriminant);
+    real sqrtd = sqrt(discriminant);
 
     // 找到最近的root点在直线中可接受范围内
-    auto root = (-half_b - sqrtd) / a;
+    root = (-half_b - sqrtd) / a;
     if (root < t_min || t_max < root) {
         root = (-half_b + sqrtd) / a;
         if (root < t_min || t_max < root)
             return false;
     }
 
+    RT_STAT_ADD(sphere_hits, 1);
+    return true;
+}
+
+bool sphere::hit(const ray &r, real t_min, real t_max, hit_record &rec) const {
+    real root;
+    if (!sphere_intersect(r, center, radius, t_min, t_max, root))
+        return false;
+
     // 更新hit_record的rec信息
     rec.t = root;
-    rec.p = r.at(rec.t);
-    // 中心点到原上点的向量 再 除以 半径（向量的长度）
-    rec.normal = (rec.p - center) / radius;
+    sphere_set_hit(r, center, radius, rec);
+    rec.mat_ptr = mat_ptr.get();
 
-    rec.mat_ptr = mat_ptr;
+    return true;
+}
 
-    // 表面法线方向一定与入射相反的
-    vec3 outward_normal = (rec.p - center) / radius;
-    rec.set_face_normal(r, outward_normal);
+bool sphere::occluded(const ray &r, real t_min, real t_max) const {
+    real root;
+    return sphere_intersect(r, center, radius, t_min, t_max, root);
+}
 
+bool sphere::bounding_box(aabb &output_box) const {
+    // 半径可以为负(空心玻璃球的内表面)，包围盒用绝对值
+    vec3 extent(fabs(radius), fabs(radius), fabs(radius));
+    output_box = aabb(center - extent, center + extent);
     return true;
 }
 
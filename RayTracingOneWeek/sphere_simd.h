@@ -0,0 +1,642 @@
+#pragma once
+#ifndef SPHERE_SIMD_H
+#define SPHERE_SIMD_H
+
+#include "rtweekend.h"
+#include "rt_stats.h"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RT_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define RT_X86_SIMD 0
+#endif
+
+// 一组球体的SoA数据。数组末尾至少留有 sphere_simd_padding 个元素，
+// 这样SIMD内核可以整块读取最后一个不满的块，多读的部分会被屏蔽掉。
+struct sphere_soa {
+    const real *center_x;
+    const real *center_y;
+    const real *center_z;
+    const real *radius;
+};
+
+// 最宽的指令集(AVX-512)一次处理的球数：double为8个，float为16个
+const int sphere_simd_max_width = static_cast<int>(64 / sizeof(real));
+const int sphere_simd_padding = sphere_simd_max_width;
+
+// 一条光线对 [first, first + count) 中的球体求交，求根方式与 sphere::hit 相同。
+// 击中时缩短t_max，closest为最近的球的下标
+typedef bool (*sphere_hit_func)(const sphere_soa &s, uint32_t first, uint32_t count,
+                                const ray &r, real t_min, real &t_max, uint32_t &closest);
+
+// 8条相干光线组成的光线包，SoA存放
+const int ray_packet_size = 8;
+
+struct ray_packet {
+    alignas(64) real ox[ray_packet_size];
+    alignas(64) real oy[ray_packet_size];
+    alignas(64) real oz[ray_packet_size];
+    alignas(64) real dx[ray_packet_size];
+    alignas(64) real dy[ray_packet_size];
+    alignas(64) real dz[ray_packet_size];
+    // 方向长度的平方，即求根公式中的a
+    alignas(64) real a[ray_packet_size];
+    // 每条光线当前最近的交点；没有使用的通道为 -infinity，永远不会击中
+    alignas(64) real t_max[ray_packet_size];
+    uint32_t closest[ray_packet_size];
+    int count;
+
+    void set(const ray *rays, int n, real t_max_init) {
+        count = n;
+        for (int k = 0; k < ray_packet_size; ++k) {
+            const ray &r = rays[k < n ? k : 0];
+            ox[k] = r.orig.x();
+            oy[k] = r.orig.y();
+            oz[k] = r.orig.z();
+            dx[k] = r.dir.x();
+            dy[k] = r.dir.y();
+            dz[k] = r.dir.z();
+            a[k] = r.dir.length_squared();
+            t_max[k] = k < n ? t_max_init : -infinity;
+            closest[k] = UINT32_MAX;
+        }
+    }
+};
+
+// 光线包对第k个球求交，更新各通道的t_max和closest
+typedef void (*sphere_packet_func)(ray_packet &p, const sphere_soa &s, uint32_t k, real t_min);
+
+// 运行时可选择的指令集
+enum class simd_isa {
+    scalar, sse2, avx2, avx512
+};
+
+const char *simd_isa_name(simd_isa isa) {
+    switch (isa) {
+        case simd_isa::sse2:
+            return "sse2";
+        case simd_isa::avx2:
+            return "avx2";
+        case simd_isa::avx512:
+            return "avx512";
+        default:
+            return "scalar";
+    }
+}
+
+bool parse_simd_isa(const char *name, simd_isa &isa) {
+    for (simd_isa candidate : {simd_isa::scalar, simd_isa::sse2, simd_isa::avx2, simd_isa::avx512}) {
+        if (std::strcmp(name, simd_isa_name(candidate)) == 0) {
+            isa = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+// 当前CPU支持的最宽指令集
+simd_isa detect_simd_isa() {
+#if RT_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return simd_isa::avx512;
+    if (__builtin_cpu_supports("avx2"))
+        return simd_isa::avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return simd_isa::sse2;
+#endif
+    return simd_isa::scalar;
+}
+
+// 标量版本，也是其他版本的参考实现
+bool sphere_hit_scalar(const sphere_soa &s, uint32_t first, uint32_t count,
+                       const ray &r, real t_min, real &t_max, uint32_t &closest) {
+    const point3 origin = r.origin();
+    const vec3 dir = r.direction();
+    const real a = dir.length_squared();
+
+    bool found = false;
+    for (uint32_t k = first; k < first + count; ++k) {
+        vec3 oc(origin.x() - s.center_x[k], origin.y() - s.center_y[k], origin.z() - s.center_z[k]);
+        real half_b = dot(oc, dir);
+        real c = oc.length_squared() - s.radius[k] * s.radius[k];
+        real discriminant = half_b * half_b - a * c;
+        if (discriminant < 0)
+            continue;
+        real sqrtd = sqrt(discriminant);
+
+        real root = (-half_b - sqrtd) / a;
+        if (root < t_min || t_max < root) {
+            root = (-half_b + sqrtd) / a;
+            if (root < t_min || t_max < root)
+                continue;
+        }
+        t_max = root;
+        closest = k;
+        found = true;
+        RT_STAT_ADD(sphere_hits, 1);
+    }
+    return found;
+}
+
+void sphere_packet_scalar(ray_packet &p, const sphere_soa &s, uint32_t k, real t_min) {
+    for (int i = 0; i < ray_packet_size; ++i) {
+        real ocx = p.ox[i] - s.center_x[k];
+        real ocy = p.oy[i] - s.center_y[k];
+        real ocz = p.oz[i] - s.center_z[k];
+        real half_b = ocx * p.dx[i] + ocy * p.dy[i] + ocz * p.dz[i];
+        real c = (ocx * ocx + ocy * ocy + ocz * ocz) - s.radius[k] * s.radius[k];
+        real discriminant = half_b * half_b - p.a[i] * c;
+        if (discriminant < 0)
+            continue;
+        real sqrtd = sqrt(discriminant);
+
+        real root = (-half_b - sqrtd) / p.a[i];
+        if (root < t_min || p.t_max[i] < root) {
+            root = (-half_b + sqrtd) / p.a[i];
+            if (root < t_min || p.t_max[i] < root)
+                continue;
+        }
+        p.t_max[i] = root;
+        p.closest[i] = k;
+        RT_STAT_ADD(sphere_hits, 1);
+    }
+}
+
+// 从候选的t中(无效的为infinity)选出最小的，平局时取下标较大的，与标量版本的顺序一致
+inline bool sphere_pick_closest(const real *t, int lanes, unsigned mask, uint32_t base,
+                                real &t_max, uint32_t &closest) {
+    bool found = false;
+    for (int lane = 0; lane < lanes; ++lane) {
+        // 与标量版本一样，只有比当前最近的撞点更近的球才计入sphere_hits
+        if (((mask >> lane) & 1u) && t[lane] <= t_max) {
+            t_max = t[lane];
+            closest = base + lane;
+            found = true;
+            RT_STAT_ADD(sphere_hits, 1);
+        }
+    }
+    return found;
+}
+
+#if RT_X86_SIMD && !defined(RT_USE_FLOAT)
+
+// double版本
+
+// SSE2: 一次2个球
+bool sphere_hit_sse2(const sphere_soa &s, uint32_t first, uint32_t count,
+                     const ray &r, real t_min, real &t_max, uint32_t &closest) {
+    const __m128d ox = _mm_set1_pd(r.orig.x()), oy = _mm_set1_pd(r.orig.y()), oz = _mm_set1_pd(r.orig.z());
+    const __m128d dx = _mm_set1_pd(r.dir.x()), dy = _mm_set1_pd(r.dir.y()), dz = _mm_set1_pd(r.dir.z());
+    const __m128d a = _mm_set1_pd(r.dir.length_squared());
+    const __m128d t_lo = _mm_set1_pd(t_min);
+    const __m128d inf = _mm_set1_pd(infinity);
+
+    bool found = false;
+    for (uint32_t k = first; k < first + count; k += 2) {
+        __m128d t_hi = _mm_set1_pd(t_max);
+        __m128d ocx = _mm_sub_pd(ox, _mm_loadu_pd(s.center_x + k));
+        __m128d ocy = _mm_sub_pd(oy, _mm_loadu_pd(s.center_y + k));
+        __m128d ocz = _mm_sub_pd(oz, _mm_loadu_pd(s.center_z + k));
+        __m128d rad = _mm_loadu_pd(s.radius + k);
+        __m128d half_b = _mm_add_pd(_mm_add_pd(_mm_mul_pd(ocx, dx), _mm_mul_pd(ocy, dy)), _mm_mul_pd(ocz, dz));
+        __m128d len2 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(ocx, ocx), _mm_mul_pd(ocy, ocy)), _mm_mul_pd(ocz, ocz));
+        __m128d c = _mm_sub_pd(len2, _mm_mul_pd(rad, rad));
+        __m128d disc = _mm_sub_pd(_mm_mul_pd(half_b, half_b), _mm_mul_pd(a, c));
+        __m128d valid = _mm_cmpge_pd(disc, _mm_setzero_pd());
+        __m128d sqrtd = _mm_sqrt_pd(_mm_max_pd(disc, _mm_setzero_pd()));
+        __m128d neg_b = _mm_sub_pd(_mm_setzero_pd(), half_b);
+        __m128d root1 = _mm_div_pd(_mm_sub_pd(neg_b, sqrtd), a);
+        __m128d root2 = _mm_div_pd(_mm_add_pd(neg_b, sqrtd), a);
+        __m128d ok1 = _mm_and_pd(_mm_cmpge_pd(root1, t_lo), _mm_cmple_pd(root1, t_hi));
+        __m128d ok2 = _mm_and_pd(_mm_cmpge_pd(root2, t_lo), _mm_cmple_pd(root2, t_hi));
+        __m128d t = _mm_or_pd(_mm_and_pd(ok1, root1),
+                              _mm_andnot_pd(ok1, _mm_or_pd(_mm_and_pd(ok2, root2), _mm_andnot_pd(ok2, inf))));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_pd(_mm_and_pd(valid, _mm_or_pd(ok1, ok2))));
+        uint32_t lanes = first + count - k;
+        if (lanes < 2)
+            mask &= (1u << lanes) - 1u;
+        if (mask) {
+            alignas(16) double tv[2];
+            _mm_store_pd(tv, t);
+            found |= sphere_pick_closest(tv, 2, mask, k, t_max, closest);
+        }
+    }
+    return found;
+}
+
+// AVX2: 一次4个球
+__attribute__((target("avx2")))
+bool sphere_hit_avx2(const sphere_soa &s, uint32_t first, uint32_t count,
+                     const ray &r, real t_min, real &t_max, uint32_t &closest) {
+    const __m256d ox = _mm256_set1_pd(r.orig.x()), oy = _mm256_set1_pd(r.orig.y()), oz = _mm256_set1_pd(r.orig.z());
+    const __m256d dx = _mm256_set1_pd(r.dir.x()), dy = _mm256_set1_pd(r.dir.y()), dz = _mm256_set1_pd(r.dir.z());
+    const __m256d a = _mm256_set1_pd(r.dir.length_squared());
+    const __m256d t_lo = _mm256_set1_pd(t_min);
+    const __m256d inf = _mm256_set1_pd(infinity);
+    const __m256d zero = _mm256_setzero_pd();
+
+    bool found = false;
+    for (uint32_t k = first; k < first + count; k += 4) {
+        __m256d t_hi = _mm256_set1_pd(t_max);
+        __m256d ocx = _mm256_sub_pd(ox, _mm256_loadu_pd(s.center_x + k));
+        __m256d ocy = _mm256_sub_pd(oy, _mm256_loadu_pd(s.center_y + k));
+        __m256d ocz = _mm256_sub_pd(oz, _mm256_loadu_pd(s.center_z + k));
+        __m256d rad = _mm256_loadu_pd(s.radius + k);
+        __m256d half_b = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, dx), _mm256_mul_pd(ocy, dy)),
+                                       _mm256_mul_pd(ocz, dz));
+        __m256d len2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, ocx), _mm256_mul_pd(ocy, ocy)),
+                                     _mm256_mul_pd(ocz, ocz));
+        __m256d c = _mm256_sub_pd(len2, _mm256_mul_pd(rad, rad));
+        __m256d disc = _mm256_sub_pd(_mm256_mul_pd(half_b, half_b), _mm256_mul_pd(a, c));
+        __m256d valid = _mm256_cmp_pd(disc, zero, _CMP_GE_OQ);
+        __m256d sqrtd = _mm256_sqrt_pd(_mm256_max_pd(disc, zero));
+        __m256d neg_b = _mm256_sub_pd(zero, half_b);
+        __m256d root1 = _mm256_div_pd(_mm256_sub_pd(neg_b, sqrtd), a);
+        __m256d root2 = _mm256_div_pd(_mm256_add_pd(neg_b, sqrtd), a);
+        __m256d ok1 = _mm256_and_pd(_mm256_cmp_pd(root1, t_lo, _CMP_GE_OQ), _mm256_cmp_pd(root1, t_hi, _CMP_LE_OQ));
+        __m256d ok2 = _mm256_and_pd(_mm256_cmp_pd(root2, t_lo, _CMP_GE_OQ), _mm256_cmp_pd(root2, t_hi, _CMP_LE_OQ));
+        __m256d t = _mm256_blendv_pd(_mm256_blendv_pd(inf, root2, ok2), root1, ok1);
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_pd(_mm256_and_pd(valid, _mm256_or_pd(ok1, ok2))));
+        uint32_t lanes = first + count - k;
+        if (lanes < 4)
+            mask &= (1u << lanes) - 1u;
+        if (mask) {
+            alignas(32) double tv[4];
+            _mm256_store_pd(tv, t);
+            found |= sphere_pick_closest(tv, 4, mask, k, t_max, closest);
+        }
+    }
+    return found;
+}
+
+// AVX-512: 一次8个球，叶子不超过8个图元时只需一次迭代
+__attribute__((target("avx512f")))
+bool sphere_hit_avx512(const sphere_soa &s, uint32_t first, uint32_t count,
+                       const ray &r, real t_min, real &t_max, uint32_t &closest) {
+    const __m512d ox = _mm512_set1_pd(r.orig.x()), oy = _mm512_set1_pd(r.orig.y()), oz = _mm512_set1_pd(r.orig.z());
+    const __m512d dx = _mm512_set1_pd(r.dir.x()), dy = _mm512_set1_pd(r.dir.y()), dz = _mm512_set1_pd(r.dir.z());
+    const __m512d a = _mm512_set1_pd(r.dir.length_squared());
+    const __m512d t_lo = _mm512_set1_pd(t_min);
+    const __m512d inf = _mm512_set1_pd(infinity);
+    const __m512d zero = _mm512_setzero_pd();
+
+    bool found = false;
+    for (uint32_t k = first; k < first + count; k += 8) {
+        uint32_t lanes = first + count - k;
+        __mmask8 active = lanes < 8 ? static_cast<__mmask8>((1u << lanes) - 1u) : static_cast<__mmask8>(0xff);
+        __m512d t_hi = _mm512_set1_pd(t_max);
+        __m512d ocx = _mm512_sub_pd(ox, _mm512_loadu_pd(s.center_x + k));
+        __m512d ocy = _mm512_sub_pd(oy, _mm512_loadu_pd(s.center_y + k));
+        __m512d ocz = _mm512_sub_pd(oz, _mm512_loadu_pd(s.center_z + k));
+        __m512d rad = _mm512_loadu_pd(s.radius + k);
+        __m512d half_b = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(ocx, dx), _mm512_mul_pd(ocy, dy)),
+                                       _mm512_mul_pd(ocz, dz));
+        __m512d len2 = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(ocx, ocx), _mm512_mul_pd(ocy, ocy)),
+                                     _mm512_mul_pd(ocz, ocz));
+        __m512d c = _mm512_sub_pd(len2, _mm512_mul_pd(rad, rad));
+        __m512d disc = _mm512_sub_pd(_mm512_mul_pd(half_b, half_b), _mm512_mul_pd(a, c));
+        __mmask8 valid = _mm512_mask_cmp_pd_mask(active, disc, zero, _CMP_GE_OQ);
+        if (!valid)
+            continue;
+        __m512d sqrtd = _mm512_sqrt_pd(_mm512_max_pd(disc, zero));
+        __m512d neg_b = _mm512_sub_pd(zero, half_b);
+        __m512d root1 = _mm512_div_pd(_mm512_sub_pd(neg_b, sqrtd), a);
+        __m512d root2 = _mm512_div_pd(_mm512_add_pd(neg_b, sqrtd), a);
+        __mmask8 ok1 = _mm512_mask_cmp_pd_mask(_mm512_cmp_pd_mask(root1, t_lo, _CMP_GE_OQ), root1, t_hi, _CMP_LE_OQ);
+        __mmask8 ok2 = _mm512_mask_cmp_pd_mask(_mm512_cmp_pd_mask(root2, t_lo, _CMP_GE_OQ), root2, t_hi, _CMP_LE_OQ);
+        __m512d t = _mm512_mask_blend_pd(ok1, _mm512_mask_blend_pd(ok2, inf, root2), root1);
+        unsigned mask = static_cast<unsigned>(valid & (ok1 | ok2));
+        if (mask) {
+            alignas(64) double tv[8];
+            _mm512_store_pd(tv, t);
+            found |= sphere_pick_closest(tv, 8, mask, k, t_max, closest);
+        }
+    }
+    return found;
+}
+
+// 光线包：8条光线对同一个球，AVX2分两半处理
+__attribute__((target("avx2")))
+void sphere_packet_avx2(ray_packet &p, const sphere_soa &s, uint32_t k, real t_min) {
+    const __m256d cx = _mm256_set1_pd(s.center_x[k]), cy = _mm256_set1_pd(s.center_y[k]);
+    const __m256d cz = _mm256_set1_pd(s.center_z[k]), rad = _mm256_set1_pd(s.radius[k]);
+    const __m256d t_lo = _mm256_set1_pd(t_min);
+    const __m256d zero = _mm256_setzero_pd();
+
+    for (int i = 0; i < ray_packet_size; i += 4) {
+        __m256d a = _mm256_load_pd(p.a + i);
+        __m256d t_hi = _mm256_load_pd(p.t_max + i);
+        __m256d ocx = _mm256_sub_pd(_mm256_load_pd(p.ox + i), cx);
+        __m256d ocy = _mm256_sub_pd(_mm256_load_pd(p.oy + i), cy);
+        __m256d ocz = _mm256_sub_pd(_mm256_load_pd(p.oz + i), cz);
+        __m256d half_b = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, _mm256_load_pd(p.dx + i)),
+                                                     _mm256_mul_pd(ocy, _mm256_load_pd(p.dy + i))),
+                                       _mm256_mul_pd(ocz, _mm256_load_pd(p.dz + i)));
+        __m256d len2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, ocx), _mm256_mul_pd(ocy, ocy)),
+                                     _mm256_mul_pd(ocz, ocz));
+        __m256d c = _mm256_sub_pd(len2, _mm256_mul_pd(rad, rad));
+        __m256d disc = _mm256_sub_pd(_mm256_mul_pd(half_b, half_b), _mm256_mul_pd(a, c));
+        __m256d valid = _mm256_cmp_pd(disc, zero, _CMP_GE_OQ);
+        if (_mm256_movemask_pd(valid) == 0)
+            continue;
+        __m256d sqrtd = _mm256_sqrt_pd(_mm256_max_pd(disc, zero));
+        __m256d neg_b = _mm256_sub_pd(zero, half_b);
+        __m256d root1 = _mm256_div_pd(_mm256_sub_pd(neg_b, sqrtd), a);
+        __m256d root2 = _mm256_div_pd(_mm256_add_pd(neg_b, sqrtd), a);
+        __m256d ok1 = _mm256_and_pd(_mm256_cmp_pd(root1, t_lo, _CMP_GE_OQ), _mm256_cmp_pd(root1, t_hi, _CMP_LE_OQ));
+        __m256d ok2 = _mm256_and_pd(_mm256_cmp_pd(root2, t_lo, _CMP_GE_OQ), _mm256_cmp_pd(root2, t_hi, _CMP_LE_OQ));
+        __m256d hit = _mm256_and_pd(valid, _mm256_or_pd(ok1, ok2));
+        int mask = _mm256_movemask_pd(hit);
+        if (mask == 0)
+            continue;
+        __m256d t = _mm256_blendv_pd(root2, root1, ok1);
+        _mm256_store_pd(p.t_max + i, _mm256_blendv_pd(t_hi, t, hit));
+        for (int lane = 0; lane < 4; ++lane)
+            if ((mask >> lane) & 1) {
+                p.closest[i + lane] = k;
+                RT_STAT_ADD(sphere_hits, 1);
+            }
+    }
+}
+
+// 光线包：AVX-512一次处理全部8条光线
+__attribute__((target("avx512f")))
+void sphere_packet_avx512(ray_packet &p, const sphere_soa &s, uint32_t k, real t_min) {
+    const __m512d zero = _mm512_setzero_pd();
+    __m512d a = _mm512_load_pd(p.a);
+    __m512d t_hi = _mm512_load_pd(p.t_max);
+    __m512d ocx = _mm512_sub_pd(_mm512_load_pd(p.ox), _mm512_set1_pd(s.center_x[k]));
+    __m512d ocy = _mm512_sub_pd(_mm512_load_pd(p.oy), _mm512_set1_pd(s.center_y[k]));
+    __m512d ocz = _mm512_sub_pd(_mm512_load_pd(p.oz), _mm512_set1_pd(s.center_z[k]));
+    __m512d rad = _mm512_set1_pd(s.radius[k]);
+    __m512d half_b = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(ocx, _mm512_load_pd(p.dx)),
+                                                 _mm512_mul_pd(ocy, _mm512_load_pd(p.dy))),
+                                   _mm512_mul_pd(ocz, _mm512_load_pd(p.dz)));
+    __m512d len2 = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(ocx, ocx), _mm512_mul_pd(ocy, ocy)),
+                                 _mm512_mul_pd(ocz, ocz));
+    __m512d c = _mm512_sub_pd(len2, _mm512_mul_pd(rad, rad));
+    __m512d disc = _mm512_sub_pd(_mm512_mul_pd(half_b, half_b), _mm512_mul_pd(a, c));
+    __mmask8 valid = _mm512_cmp_pd_mask(disc, zero, _CMP_GE_OQ);
+    if (!valid)
+        return;
+    __m512d t_lo = _mm512_set1_pd(t_min);
+    __m512d sqrtd = _mm512_sqrt_pd(_mm512_max_pd(disc, zero));
+    __m512d neg_b = _mm512_sub_pd(zero, half_b);
+    __m512d root1 = _mm512_div_pd(_mm512_sub_pd(neg_b, sqrtd), a);
+    __m512d root2 = _mm512_div_pd(_mm512_add_pd(neg_b, sqrtd), a);
+    __mmask8 ok1 = _mm512_mask_cmp_pd_mask(_mm512_cmp_pd_mask(root1, t_lo, _CMP_GE_OQ), root1, t_hi, _CMP_LE_OQ);
+    __mmask8 ok2 = _mm512_mask_cmp_pd_mask(_mm512_cmp_pd_mask(root2, t_lo, _CMP_GE_OQ), root2, t_hi, _CMP_LE_OQ);
+    __mmask8 hit = valid & (ok1 | ok2);
+    if (!hit)
+        return;
+    __m512d t = _mm512_mask_blend_pd(ok1, root2, root1);
+    _mm512_store_pd(p.t_max, _mm512_mask_blend_pd(hit, t_hi, t));
+    for (int lane = 0; lane < 8; ++lane)
+        if ((hit >> lane) & 1) {
+            p.closest[lane] = k;
+            RT_STAT_ADD(sphere_hits, 1);
+        }
+}
+
+#endif
+
+#if RT_X86_SIMD && defined(RT_USE_FLOAT)
+
+// float版本：每条指令处理的球数是double的两倍，求根方式与double版本相同
+
+// SSE2: 一次4个球
+bool sphere_hit_sse2(const sphere_soa &s, uint32_t first, uint32_t count,
+                     const ray &r, real t_min, real &t_max, uint32_t &closest) {
+    const __m128 ox = _mm_set1_ps(r.orig.x()), oy = _mm_set1_ps(r.orig.y()), oz = _mm_set1_ps(r.orig.z());
+    const __m128 dx = _mm_set1_ps(r.dir.x()), dy = _mm_set1_ps(r.dir.y()), dz = _mm_set1_ps(r.dir.z());
+    const __m128 a = _mm_set1_ps(r.dir.length_squared());
+    const __m128 t_lo = _mm_set1_ps(t_min);
+    const __m128 inf = _mm_set1_ps(static_cast<float>(infinity));
+
+    bool found = false;
+    for (uint32_t k = first; k < first + count; k += 4) {
+        __m128 t_hi = _mm_set1_ps(t_max);
+        __m128 ocx = _mm_sub_ps(ox, _mm_loadu_ps(s.center_x + k));
+        __m128 ocy = _mm_sub_ps(oy, _mm_loadu_ps(s.center_y + k));
+        __m128 ocz = _mm_sub_ps(oz, _mm_loadu_ps(s.center_z + k));
+        __m128 rad = _mm_loadu_ps(s.radius + k);
+        __m128 half_b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, dx), _mm_mul_ps(ocy, dy)), _mm_mul_ps(ocz, dz));
+        __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)), _mm_mul_ps(ocz, ocz));
+        __m128 c = _mm_sub_ps(len2, _mm_mul_ps(rad, rad));
+        __m128 disc = _mm_sub_ps(_mm_mul_ps(half_b, half_b), _mm_mul_ps(a, c));
+        __m128 valid = _mm_cmpge_ps(disc, _mm_setzero_ps());
+        __m128 sqrtd = _mm_sqrt_ps(_mm_max_ps(disc, _mm_setzero_ps()));
+        __m128 neg_b = _mm_sub_ps(_mm_setzero_ps(), half_b);
+        __m128 root1 = _mm_div_ps(_mm_sub_ps(neg_b, sqrtd), a);
+        __m128 root2 = _mm_div_ps(_mm_add_ps(neg_b, sqrtd), a);
+        __m128 ok1 = _mm_and_ps(_mm_cmpge_ps(root1, t_lo), _mm_cmple_ps(root1, t_hi));
+        __m128 ok2 = _mm_and_ps(_mm_cmpge_ps(root2, t_lo), _mm_cmple_ps(root2, t_hi));
+        __m128 t = _mm_or_ps(_mm_and_ps(ok1, root1),
+                             _mm_andnot_ps(ok1, _mm_or_ps(_mm_and_ps(ok2, root2), _mm_andnot_ps(ok2, inf))));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_ps(_mm_and_ps(valid, _mm_or_ps(ok1, ok2))));
+        uint32_t lanes = first + count - k;
+        if (lanes < 4)
+            mask &= (1u << lanes) - 1u;
+        if (mask) {
+            alignas(16) float tv[4];
+            _mm_store_ps(tv, t);
+            found |= sphere_pick_closest(tv, 4, mask, k, t_max, closest);
+        }
+    }
+    return found;
+}
+
+// AVX2: 一次8个球
+__attribute__((target("avx2")))
+bool sphere_hit_avx2(const sphere_soa &s, uint32_t first, uint32_t count,
+                     const ray &r, real t_min, real &t_max, uint32_t &closest) {
+    const __m256 ox = _mm256_set1_ps(r.orig.x()), oy = _mm256_set1_ps(r.orig.y()), oz = _mm256_set1_ps(r.orig.z());
+    const __m256 dx = _mm256_set1_ps(r.dir.x()), dy = _mm256_set1_ps(r.dir.y()), dz = _mm256_set1_ps(r.dir.z());
+    const __m256 a = _mm256_set1_ps(r.dir.length_squared());
+    const __m256 t_lo = _mm256_set1_ps(t_min);
+    const __m256 inf = _mm256_set1_ps(static_cast<float>(infinity));
+    const __m256 zero = _mm256_setzero_ps();
+
+    bool found = false;
+    for (uint32_t k = first; k < first + count; k += 8) {
+        __m256 t_hi = _mm256_set1_ps(t_max);
+        __m256 ocx = _mm256_sub_ps(ox, _mm256_loadu_ps(s.center_x + k));
+        __m256 ocy = _mm256_sub_ps(oy, _mm256_loadu_ps(s.center_y + k));
+        __m256 ocz = _mm256_sub_ps(oz, _mm256_loadu_ps(s.center_z + k));
+        __m256 rad = _mm256_loadu_ps(s.radius + k);
+        __m256 half_b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, dx), _mm256_mul_ps(ocy, dy)),
+                                      _mm256_mul_ps(ocz, dz));
+        __m256 len2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, ocx), _mm256_mul_ps(ocy, ocy)),
+                                    _mm256_mul_ps(ocz, ocz));
+        __m256 c = _mm256_sub_ps(len2, _mm256_mul_ps(rad, rad));
+        __m256 disc = _mm256_sub_ps(_mm256_mul_ps(half_b, half_b), _mm256_mul_ps(a, c));
+        __m256 valid = _mm256_cmp_ps(disc, zero, _CMP_GE_OQ);
+        __m256 sqrtd = _mm256_sqrt_ps(_mm256_max_ps(disc, zero));
+        __m256 neg_b = _mm256_sub_ps(zero, half_b);
+        __m256 root1 = _mm256_div_ps(_mm256_sub_ps(neg_b, sqrtd), a);
+        __m256 root2 = _mm256_div_ps(_mm256_add_ps(neg_b, sqrtd), a);
+        __m256 ok1 = _mm256_and_ps(_mm256_cmp_ps(root1, t_lo, _CMP_GE_OQ), _mm256_cmp_ps(root1, t_hi, _CMP_LE_OQ));
+        __m256 ok2 = _mm256_and_ps(_mm256_cmp_ps(root2, t_lo, _CMP_GE_OQ), _mm256_cmp_ps(root2, t_hi, _CMP_LE_OQ));
+        __m256 t = _mm256_blendv_ps(_mm256_blendv_ps(inf, root2, ok2), root1, ok1);
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_and_ps(valid, _mm256_or_ps(ok1, ok2))));
+        uint32_t lanes = first + count - k;
+        if (lanes < 8)
+            mask &= (1u << lanes) - 1u;
+        if (mask) {
+            alignas(32) float tv[8];
+            _mm256_store_ps(tv, t);
+            found |= sphere_pick_closest(tv, 8, mask, k, t_max, closest);
+        }
+    }
+    return found;
+}
+
+// AVX-512: 一次16个球，叶子不超过16个图元时只需一次迭代
+__attribute__((target("avx512f")))
+bool sphere_hit_avx512(const sphere_soa &s, uint32_t first, uint32_t count,
+                       const ray &r, real t_min, real &t_max, uint32_t &closest) {
+    const __m512 ox = _mm512_set1_ps(r.orig.x()), oy = _mm512_set1_ps(r.orig.y()), oz = _mm512_set1_ps(r.orig.z());
+    const __m512 dx = _mm512_set1_ps(r.dir.x()), dy = _mm512_set1_ps(r.dir.y()), dz = _mm512_set1_ps(r.dir.z());
+    const __m512 a = _mm512_set1_ps(r.dir.length_squared());
+    const __m512 t_lo = _mm512_set1_ps(t_min);
+    const __m512 inf = _mm512_set1_ps(static_cast<float>(infinity));
+    const __m512 zero = _mm512_setzero_ps();
+
+    bool found = false;
+    for (uint32_t k = first; k < first + count; k += 16) {
+        uint32_t lanes = first + count - k;
+        __mmask16 active = lanes < 16 ? static_cast<__mmask16>((1u << lanes) - 1u) : static_cast<__mmask16>(0xffff);
+        __m512 t_hi = _mm512_set1_ps(t_max);
+        __m512 ocx = _mm512_sub_ps(ox, _mm512_loadu_ps(s.center_x + k));
+        __m512 ocy = _mm512_sub_ps(oy, _mm512_loadu_ps(s.center_y + k));
+        __m512 ocz = _mm512_sub_ps(oz, _mm512_loadu_ps(s.center_z + k));
+        __m512 rad = _mm512_loadu_ps(s.radius + k);
+        __m512 half_b = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(ocx, dx), _mm512_mul_ps(ocy, dy)),
+                                      _mm512_mul_ps(ocz, dz));
+        __m512 len2 = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(ocx, ocx), _mm512_mul_ps(ocy, ocy)),
+                                    _mm512_mul_ps(ocz, ocz));
+        __m512 c = _mm512_sub_ps(len2, _mm512_mul_ps(rad, rad));
+        __m512 disc = _mm512_sub_ps(_mm512_mul_ps(half_b, half_b), _mm512_mul_ps(a, c));
+        __mmask16 valid = _mm512_mask_cmp_ps_mask(active, disc, zero, _CMP_GE_OQ);
+        if (!valid)
+            continue;
+        __m512 sqrtd = _mm512_sqrt_ps(_mm512_max_ps(disc, zero));
+        __m512 neg_b = _mm512_sub_ps(zero, half_b);
+        __m512 root1 = _mm512_div_ps(_mm512_sub_ps(neg_b, sqrtd), a);
+        __m512 root2 = _mm512_div_ps(_mm512_add_ps(neg_b, sqrtd), a);
+        __mmask16 ok1 = _mm512_mask_cmp_ps_mask(_mm512_cmp_ps_mask(root1, t_lo, _CMP_GE_OQ), root1, t_hi, _CMP_LE_OQ);
+        __mmask16 ok2 = _mm512_mask_cmp_ps_mask(_mm512_cmp_ps_mask(root2, t_lo, _CMP_GE_OQ), root2, t_hi, _CMP_LE_OQ);
+        __m512 t = _mm512_mask_blend_ps(ok1, _mm512_mask_blend_ps(ok2, inf, root2), root1);
+        unsigned mask = static_cast<unsigned>(valid & (ok1 | ok2));
+        if (mask) {
+            alignas(64) float tv[16];
+            _mm512_store_ps(tv, t);
+            found |= sphere_pick_closest(tv, 16, mask, k, t_max, closest);
+        }
+    }
+    return found;
+}
+
+// 光线包：8条光线的float正好放进一个256位寄存器，AVX2一次处理全部光线
+__attribute__((target("avx2")))
+void sphere_packet_avx2(ray_packet &p, const sphere_soa &s, uint32_t k, real t_min) {
+    const __m256 zero = _mm256_setzero_ps();
+    __m256 a = _mm256_load_ps(p.a);
+    __m256 t_hi = _mm256_load_ps(p.t_max);
+    __m256 ocx = _mm256_sub_ps(_mm256_load_ps(p.ox), _mm256_set1_ps(s.center_x[k]));
+    __m256 ocy = _mm256_sub_ps(_mm256_load_ps(p.oy), _mm256_set1_ps(s.center_y[k]));
+    __m256 ocz = _mm256_sub_ps(_mm256_load_ps(p.oz), _mm256_set1_ps(s.center_z[k]));
+    __m256 rad = _mm256_set1_ps(s.radius[k]);
+    __m256 half_b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, _mm256_load_ps(p.dx)),
+                                                _mm256_mul_ps(ocy, _mm256_load_ps(p.dy))),
+                                  _mm256_mul_ps(ocz, _mm256_load_ps(p.dz)));
+    __m256 len2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, ocx), _mm256_mul_ps(ocy, ocy)),
+                                _mm256_mul_ps(ocz, ocz));
+    __m256 c = _mm256_sub_ps(len2, _mm256_mul_ps(rad, rad));
+    __m256 disc = _mm256_sub_ps(_mm256_mul_ps(half_b, half_b), _mm256_mul_ps(a, c));
+    __m256 valid = _mm256_cmp_ps(disc, zero, _CMP_GE_OQ);
+    if (_mm256_movemask_ps(valid) == 0)
+        return;
+    __m256 t_lo = _mm256_set1_ps(t_min);
+    __m256 sqrtd = _mm256_sqrt_ps(_mm256_max_ps(disc, zero));
+    __m256 neg_b = _mm256_sub_ps(zero, half_b);
+    __m256 root1 = _mm256_div_ps(_mm256_sub_ps(neg_b, sqrtd), a);
+    __m256 root2 = _mm256_div_ps(_mm256_add_ps(neg_b, sqrtd), a);
+    __m256 ok1 = _mm256_and_ps(_mm256_cmp_ps(root1, t_lo, _CMP_GE_OQ), _mm256_cmp_ps(root1, t_hi, _CMP_LE_OQ));
+    __m256 ok2 = _mm256_and_ps(_mm256_cmp_ps(root2, t_lo, _CMP_GE_OQ), _mm256_cmp_ps(root2, t_hi, _CMP_LE_OQ));
+    __m256 hit = _mm256_and_ps(valid, _mm256_or_ps(ok1, ok2));
+    int mask = _mm256_movemask_ps(hit);
+    if (mask == 0)
+        return;
+    __m256 t = _mm256_blendv_ps(root2, root1, ok1);
+    _mm256_store_ps(p.t_max, _mm256_blendv_ps(t_hi, t, hit));
+    for (int lane = 0; lane < 8; ++lane)
+        if ((mask >> lane) & 1) {
+            p.closest[lane] = k;
+            RT_STAT_ADD(sphere_hits, 1);
+        }
+}
+
+// AVX-512没有更宽的必要，直接使用AVX2的版本
+__attribute__((target("avx512f")))
+void sphere_packet_avx512(ray_packet &p, const sphere_soa &s, uint32_t k, real t_min) {
+    sphere_packet_avx2(p, s, k, t_min);
+}
+
+#endif
+
+// 每个指令集一次检测的球数
+int simd_isa_width(simd_isa isa) {
+    switch (isa) {
+        case simd_isa::sse2:
+            return static_cast<int>(16 / sizeof(real));
+        case simd_isa::avx2:
+            return static_cast<int>(32 / sizeof(real));
+        case simd_isa::avx512:
+            return static_cast<int>(64 / sizeof(real));
+        default:
+            return 1;
+    }
+}
+
+// 按指令集选择内核，不支持的指令集退回到能用的最宽的一档
+sphere_hit_func sphere_hit_kernel(simd_isa isa) {
+    if (isa > detect_simd_isa())
+        isa = detect_simd_isa();
+#if RT_X86_SIMD
+    switch (isa) {
+        case simd_isa::avx512:
+            return sphere_hit_avx512;
+        case simd_isa::avx2:
+            return sphere_hit_avx2;
+        case simd_isa::sse2:
+            return sphere_hit_sse2;
+        default:
+            break;
+    }
+#endif
+    return sphere_hit_scalar;
+}
+
+sphere_packet_func sphere_packet_kernel(simd_isa isa) {
+    if (isa > detect_simd_isa())
+        isa = detect_simd_isa();
+#if RT_X86_SIMD
+    switch (isa) {
+        case simd_isa::avx512:
+            return sphere_packet_avx512;
+        case simd_isa::avx2:
+            return sphere_packet_avx2;
+        default:
+            break;
+    }
+#endif
+    return sphere_packet_scalar;
+}
+
+#endif
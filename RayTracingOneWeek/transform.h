@@ -0,0 +1,140 @@
+#pragma once
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include "rtweekend.h"
+#include "aabb.h"
+
+// 仿射变换，保存为4x3矩阵：p' = M p + t，m[i][3]是平移
+class affine_transform {
+public:
+    // 默认是单位变换
+    affine_transform() {
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 4; ++j)
+                m[i][j] = i == j ? 1.0 : 0.0;
+    }
+
+    static affine_transform translate(const vec3 &offset) {
+        affine_transform t;
+        for (int i = 0; i < 3; ++i)
+            t.m[i][3] = offset[i];
+        return t;
+    }
+
+    static affine_transform scale(const vec3 &factor) {
+        affine_transform t;
+        for (int i = 0; i < 3; ++i)
+            t.m[i][i] = factor[i];
+        return t;
+    }
+
+    // 绕过原点的axis轴旋转degrees度，从轴的正方向看是逆时针
+    static affine_transform rotate(const vec3 &axis, double degrees);
+
+    // 先做rhs，再做*this
+    affine_transform operator*(const affine_transform &rhs) const;
+
+    // 逆变换，矩阵必须可逆
+    affine_transform inverse() const;
+
+    point3 point(const point3 &p) const {
+        return point3(m[0][0] * p.x() + m[0][1] * p.y() + m[0][2] * p.z() + m[0][3],
+                      m[1][0] * p.x() + m[1][1] * p.y() + m[1][2] * p.z() + m[1][3],
+                      m[2][0] * p.x() + m[2][1] * p.y() + m[2][2] * p.z() + m[2][3]);
+    }
+
+    // 带误差的版本：p本身每个分量的绝对误差不超过error_in，返回时error_out是结果的误差上界
+    point3 point(const point3 &p, real error_in, real &error_out) const {
+        real bound = 0, scale = 0;
+        for (int i = 0; i < 3; ++i) {
+            bound = std::fmax(bound, std::fabs(m[i][0] * p.x()) + std::fabs(m[i][1] * p.y()) +
+                                     std::fabs(m[i][2] * p.z()) + std::fabs(m[i][3]));
+            scale = std::fmax(scale, std::fabs(m[i][0]) + std::fabs(m[i][1]) + std::fabs(m[i][2]));
+        }
+        error_out = error_gamma(3) * bound + (1 + error_gamma(3)) * scale * error_in;
+        return point(p);
+    }
+
+    // 方向不受平移影响
+    vec3 vector(const vec3 &v) const {
+        return vec3(m[0][0] * v.x() + m[0][1] * v.y() + m[0][2] * v.z(),
+                    m[1][0] * v.x() + m[1][1] * v.y() + m[1][2] * v.z(),
+                    m[2][0] * v.x() + m[2][1] * v.y() + m[2][2] * v.z());
+    }
+
+    // 用M的转置变换方向。法向量要用逆矩阵的转置变换，所以对逆变换调用这个函数
+    vec3 transposed_vector(const vec3 &v) const {
+        return vec3(m[0][0] * v.x() + m[1][0] * v.y() + m[2][0] * v.z(),
+                    m[0][1] * v.x() + m[1][1] * v.y() + m[2][1] * v.z(),
+                    m[0][2] * v.x() + m[1][2] * v.y() + m[2][2] * v.z());
+    }
+
+    // 变换后的包围盒：包住变换后的8个角
+    aabb box(const aabb &b) const {
+        aabb result;
+        for (int k = 0; k < 8; ++k)
+            result.expand(point(point3(k & 1 ? b.max().x() : b.min().x(),
+                                       k & 2 ? b.max().y() : b.min().y(),
+                                       k & 4 ? b.max().z() : b.min().z())));
+        return result;
+    }
+
+public:
+    real m[3][4];
+};
+
+affine_transform affine_transform::rotate(const vec3 &axis, double degrees) {
+    vec3 a = unit_vector(axis);
+    double theta = degrees_to_radians(degrees);
+    double c = cos(theta), s = sin(theta), k = 1.0 - c;
+
+    affine_transform t;
+    t.m[0][0] = a.x() * a.x() * k + c;
+    t.m[0][1] = a.x() * a.y() * k - a.z() * s;
+    t.m[0][2] = a.x() * a.z() * k + a.y() * s;
+    t.m[1][0] = a.y() * a.x() * k + a.z() * s;
+    t.m[1][1] = a.y() * a.y() * k + c;
+    t.m[1][2] = a.y() * a.z() * k - a.x() * s;
+    t.m[2][0] = a.z() * a.x() * k - a.y() * s;
+    t.m[2][1] = a.z() * a.y() * k + a.x() * s;
+    t.m[2][2] = a.z() * a.z() * k + c;
+    return t;
+}
+
+affine_transform affine_transform::operator*(const affine_transform &rhs) const {
+    affine_transform t;
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            double sum = j == 3 ? m[i][3] : 0.0;
+            for (int k = 0; k < 3; ++k)
+                sum += m[i][k] * rhs.m[k][j];
+            t.m[i][j] = sum;
+        }
+    }
+    return t;
+}
+
+affine_transform affine_transform::inverse() const {
+    // 3x3部分用伴随矩阵求逆，平移为 -M^-1 t
+    double c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+    double c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+    double c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+    double inv_det = 1.0 / (m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02);
+
+    affine_transform t;
+    t.m[0][0] = c00 * inv_det;
+    t.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * inv_det;
+    t.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inv_det;
+    t.m[1][0] = c01 * inv_det;
+    t.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inv_det;
+    t.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * inv_det;
+    t.m[2][0] = c02 * inv_det;
+    t.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * inv_det;
+    t.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inv_det;
+    for (int i = 0; i < 3; ++i)
+        t.m[i][3] = -(t.m[i][0] * m[0][3] + t.m[i][1] * m[1][3] + t.m[i][2] * m[2][3]);
+    return t;
+}
+
+#endif
@@ -0,0 +1,372 @@
+#pragma once
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+
+#include "rtweekend.h"
+#include "hittable.h"
+#include "flat_bvh.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 三角网格的顶点，用float保存以减少内存，求交时转换为real
+struct mesh_vertex {
+    float x, y, z;
+
+    point3 point() const { return point3(x, y, z); }
+};
+
+// 网格数据：带索引的顶点/法线缓冲区和三角形上的BVH。
+// 多个triangle_mesh(例如不同材质或之后的实例)可以共享同一份mesh_data。
+// 建树之后三角形按叶子顺序重新排列，叶子中的三角形在索引数组里是连续的一段。
+class mesh_data {
+public:
+    size_t triangle_count() const { return indices.size() / 3; }
+
+    // 在threads个线程上建树，叶子中最多max_leaf_size个三角形
+    void build_bvh(int max_leaf_size = 4, int threads = 0);
+
+    // 顶点、法线、索引和BVH节点占用的字节数
+    size_t memory_bytes() const;
+
+    void report(std::ostream &out) const;
+
+public:
+    std::vector<mesh_vertex> positions;
+    std::vector<mesh_vertex> normals;
+    // 每个三角形三个顶点下标
+    std::vector<uint32_t> indices;
+    // 每个三角形三个法线下标，没有法线时为空，使用几何法线
+    std::vector<uint32_t> normal_indices;
+    flat_bvh bvh;
+};
+
+// 读取OBJ文件中的 v、vn、f，多边形按扇形拆成三角形，其他记录忽略
+bool load_obj(const std::string &path, mesh_data &mesh);
+
+// 使用watertight的光线-三角形求交(Woop, Benthin, Wald 2013)：
+// 把光线方向变换到+z轴上，三条边函数在相邻三角形的公共边上得到完全相同的结果，光线不会从缝里漏过去
+struct triangle_ray {
+    int kx, ky, kz;
+    real sx, sy, sz;
+    point3 org;
+
+    explicit triangle_ray(const ray &r);
+
+    // 击中时返回true并写入t和重心坐标(b0对应第一个顶点)
+    bool hit(const point3 &p0, const point3 &p1, const point3 &p2, real t_min, real t_max,
+             real &t, real &b0, real &b1, real &b2) const;
+};
+
+class triangle_mesh : public hittable {
+public:
+    triangle_mesh() {}
+
+    triangle_mesh(shared_ptr<mesh_data> mesh, shared_ptr<material> m) : mesh(mesh), mat_ptr(m) {}
+
+    virtual bool hit(
+            const ray &r, real t_min, real t_max, hit_record &rec) const override;
+
+    virtual bool occluded(const ray &r, real t_min, real t_max) const override;
+
+    virtual bool bounding_box(aabb &output_box) const override;
+
+public:
+    shared_ptr<mesh_data> mesh;
+    shared_ptr<material> mat_ptr;
+};
+
+void mesh_data::build_bvh(int max_leaf_size, int threads) {
+    size_t n = triangle_count();
+    std::vector<bvh_build_item> items(n);
+    for (size_t k = 0; k < n; ++k) {
+        aabb box;
+        for (int c = 0; c < 3; ++c)
+            box.expand(positions[indices[3 * k + c]].point());
+        items[k] = {box, box.centroid(), k};
+    }
+
+    if (threads <= 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    bvh.build_parallel(items, max_leaf_size, 1, threads);
+
+    // 按叶子顺序重新排列三角形，之后不再需要order
+    std::vector<uint32_t> sorted(indices.size());
+    for (size_t k = 0; k < n; ++k)
+        std::memcpy(&sorted[3 * k], &indices[3 * bvh.order[k]], 3 * sizeof(uint32_t));
+    indices.swap(sorted);
+    if (!normal_indices.empty()) {
+        for (size_t k = 0; k < n; ++k)
+            std::memcpy(&sorted[3 * k], &normal_indices[3 * bvh.order[k]], 3 * sizeof(uint32_t));
+        normal_indices.swap(sorted);
+    }
+    bvh.order.clear();
+    bvh.order.shrink_to_fit();
+}
+
+size_t mesh_data::memory_bytes() const {
+    return positions.size() * sizeof(mesh_vertex) + normals.size() * sizeof(mesh_vertex) +
+           indices.size() * sizeof(uint32_t) + normal_indices.size() * sizeof(uint32_t) +
+           bvh.node_count * sizeof(flat_bvh_node);
+}
+
+void mesh_data::report(std::ostream &out) const {
+    size_t triangles = triangle_count();
+    out << "mesh: " << triangles << " triangles, " << positions.size() << " vertices, "
+        << normals.size() << " normals, " << bvh.node_count << " bvh nodes, " << memory_bytes() << " bytes ("
+        << (triangles > 0 ? static_cast<double>(memory_bytes()) / triangles : 0.0) << " bytes/triangle)\n";
+}
+
+// OBJ的下标从1开始，负数表示从末尾往前数；返回从0开始的下标，无效时返回false
+inline bool obj_index(long value, size_t count, uint32_t &index) {
+    long long resolved = value > 0 ? value - 1 : static_cast<long long>(count) + value;
+    if (value == 0 || resolved < 0 || resolved >= static_cast<long long>(count))
+        return false;
+    index = static_cast<uint32_t>(resolved);
+    return true;
+}
+
+bool load_obj(const std::string &path, mesh_data &mesh) {
+    // 一次读入整个文件，用strtod/strtol直接在缓冲区上解析
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        std::cerr << "cannot open mesh " << path << "\n";
+        return false;
+    }
+    std::vector<char> text;
+    char buffer[1 << 16];
+    size_t read;
+    while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+        text.insert(text.end(), buffer, buffer + read);
+    std::fclose(file);
+    text.push_back('\0');
+
+    mesh = mesh_data();
+    bool any_face_normals = false;
+    bool all_face_normals = true;
+    std::vector<uint32_t> face_positions, face_normals;
+    int line_number = 0;
+
+    const char *p = text.data();
+    while (*p) {
+        ++line_number;
+        const char *line_end = std::strchr(p, '\n');
+        if (!line_end)
+            line_end = p + std::strlen(p);
+
+        while (*p == ' ' || *p == '\t')
+            ++p;
+        if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+            char *end;
+            mesh_vertex v;
+            v.x = std::strtof(p + 2, &end);
+            v.y = std::strtof(end, &end);
+            v.z = std::strtof(end, &end);
+            mesh.positions.push_back(v);
+        } else if (p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t')) {
+            char *end;
+            mesh_vertex n;
+            n.x = std::strtof(p + 3, &end);
+            n.y = std::strtof(end, &end);
+            n.z = std::strtof(end, &end);
+            mesh.normals.push_back(n);
+        } else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+            // 每个角是 v、v/vt、v//vn 或 v/vt/vn
+            face_positions.clear();
+            face_normals.clear();
+            const char *q = p + 2;
+            while (true) {
+                // strtol会跳过换行，先确认这一行还有下标
+                while (q < line_end && (*q == ' ' || *q == '\t' || *q == '\r'))
+                    ++q;
+                if (q >= line_end)
+                    break;
+                char *end;
+                long v = std::strtol(q, &end, 10);
+                if (end == q)
+                    break;
+                uint32_t index;
+                if (!obj_index(v, mesh.positions.size(), index)) {
+                    std::cerr << path << ":" << line_number << ": invalid vertex index\n";
+                    return false;
+                }
+                face_positions.push_back(index);
+                q = end;
+                long vn = 0;
+                if (*q == '/') {
+                    ++q;
+                    // 纹理坐标不使用，跳过
+                    if (*q != '/') {
+                        std::strtol(q, &end, 10);
+                        q = end;
+                    }
+                    if (*q == '/') {
+                        ++q;
+                        vn = std::strtol(q, &end, 10);
+                        q = end;
+                    }
+                }
+                if (vn != 0) {
+                    if (!obj_index(vn, mesh.normals.size(), index)) {
+                        std::cerr << path << ":" << line_number << ": invalid normal index\n";
+                        return false;
+                    }
+                    face_normals.push_back(index);
+                }
+            }
+            if (face_positions.size() < 3) {
+                std::cerr << path << ":" << line_number << ": face with fewer than 3 vertices\n";
+                return false;
+            }
+            bool has_normals = face_normals.size() == face_positions.size();
+            any_face_normals = any_face_normals || has_normals;
+            all_face_normals = all_face_normals && has_normals;
+            for (size_t k = 1; k + 1 < face_positions.size(); ++k) {
+                mesh.indices.insert(mesh.indices.end(), {face_positions[0], face_positions[k], face_positions[k + 1]});
+                if (has_normals)
+                    mesh.normal_indices.insert(mesh.normal_indices.end(),
+                                               {face_normals[0], face_normals[k], face_normals[k + 1]});
+            }
+        }
+        p = *line_end ? line_end + 1 : line_end;
+    }
+
+    // 只有所有面都带法线时才使用插值法线
+    if (!any_face_normals || !all_face_normals) {
+        mesh.normals.clear();
+        mesh.normal_indices.clear();
+    }
+    mesh.positions.shrink_to_fit();
+    mesh.normals.shrink_to_fit();
+    mesh.indices.shrink_to_fit();
+    mesh.normal_indices.shrink_to_fit();
+    return true;
+}
+
+triangle_ray::triangle_ray(const ray &r) : org(r.origin()) {
+    const vec3 &d = r.direction();
+    kz = fabs(d.x()) > fabs(d.y()) ? (fabs(d.x()) > fabs(d.z()) ? 0 : 2) : (fabs(d.y()) > fabs(d.z()) ? 1 : 2);
+    kx = (kz + 1) % 3;
+    ky = (kx + 1) % 3;
+    // 保持三角形的绕向
+    if (d[kz] < 0)
+        std::swap(kx, ky);
+    sx = d[kx] / d[kz];
+    sy = d[ky] / d[kz];
+    sz = 1 / d[kz];
+}
+
+bool triangle_ray::hit(const point3 &p0, const point3 &p1, const point3 &p2, real t_min, real t_max,
+                       real &t, real &b0, real &b1, real &b2) const {
+    const vec3 a = p0 - org, b = p1 - org, c = p2 - org;
+    const real ax = a[kx] - sx * a[kz], ay = a[ky] - sy * a[kz];
+    const real bx = b[kx] - sx * b[kz], by = b[ky] - sy * b[kz];
+    const real cx = c[kx] - sx * c[kz], cy = c[ky] - sy * c[kz];
+
+    // 边函数，三者同号时光线穿过三角形
+    real u = cx * by - cy * bx;
+    real v = ax * cy - ay * cx;
+    real w = bx * ay - by * ax;
+    if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0))
+        return false;
+    real det = u + v + w;
+    if (det == 0)
+        return false;
+
+    real t_scaled = u * sz * a[kz] + v * sz * b[kz] + w * sz * c[kz];
+    real inv_det = 1 / det;
+    t = t_scaled * inv_det;
+    if (t < t_min || t > t_max)
+        return false;
+    b0 = u * inv_det;
+    b1 = v * inv_det;
+    b2 = w * inv_det;
+    return true;
+}
+
+bool triangle_mesh::hit(const ray &r, real t_min, real t_max, hit_record &rec) const {
+    const mesh_data &m = *mesh;
+    const triangle_ray tri_ray(r);
+    const uint32_t *indices = m.indices.data();
+    const mesh_vertex *positions = m.positions.data();
+
+    // 遍历时只记录最近的三角形和重心坐标，命中信息最后只计算一次
+    uint32_t closest = 0;
+    real closest_b1 = 0, closest_b2 = 0;
+    real closest_t = t_max;
+    bool hit_anything = m.bvh.traverse(r, t_min, closest_t, [&](uint32_t first, uint32_t count,
+                                                                real t_lo, real &t_hi) {
+        RT_STAT_ADD(primitive_tests, count);
+        bool hit_leaf = false;
+        for (uint32_t k = first; k < first + count; ++k) {
+            const uint32_t *tri = indices + 3 * k;
+            real t, b0, b1, b2;
+            if (tri_ray.hit(positions[tri[0]].point(), positions[tri[1]].point(), positions[tri[2]].point(),
+                            t_lo, t_hi, t, b0, b1, b2)) {
+                t_hi = t;
+                closest = k;
+                closest_b1 = b1;
+                closest_b2 = b2;
+                hit_leaf = true;
+            }
+        }
+        return hit_leaf;
+    });
+    if (!hit_anything)
+        return false;
+
+    const uint32_t *tri = indices + 3 * closest;
+    point3 p0 = positions[tri[0]].point(), p1 = positions[tri[1]].point(), p2 = positions[tri[2]].point();
+    vec3 geometric_normal = unit_vector(cross(p1 - p0, p2 - p0));
+    rec.t = closest_t;
+    // 用重心坐标插值出撞点，误差只与顶点坐标的大小有关
+    real closest_b0 = 1 - closest_b1 - closest_b2;
+    rec.p = closest_b0 * p0 + closest_b1 * p1 + closest_b2 * p2;
+    rec.error = error_gamma(7) * std::fmax(max_abs(p0), std::fmax(max_abs(p1), max_abs(p2)));
+    rec.mat_ptr = mat_ptr.get();
+    rec.set_face_normal(r, geometric_normal);
+
+    if (!m.normal_indices.empty()) {
+        // 插值的着色法线，翻到与几何法线同一侧
+        const uint32_t *ni = m.normal_indices.data() + 3 * closest;
+        vec3 shading = closest_b0 * m.normals[ni[0]].point() +
+                       closest_b1 * m.normals[ni[1]].point() + closest_b2 * m.normals[ni[2]].point();
+        if (shading.length_squared() > 0) {
+            shading = unit_vector(shading);
+            rec.normal = dot(shading, rec.normal) < 0 ? -shading : shading;
+        }
+    }
+    return true;
+}
+
+bool triangle_mesh::occluded(const ray &r, real t_min, real t_max) const {
+    const mesh_data &m = *mesh;
+    const triangle_ray tri_ray(r);
+    const uint32_t *indices = m.indices.data();
+    const mesh_vertex *positions = m.positions.data();
+
+    return m.bvh.occluded(r, t_min, t_max, [&](uint32_t first, uint32_t count, real t_lo, real t_hi) {
+        for (uint32_t k = first; k < first + count; ++k) {
+            RT_STAT_ADD(primitive_tests, 1);
+            const uint32_t *tri = indices + 3 * k;
+            real t, b0, b1, b2;
+            if (tri_ray.hit(positions[tri[0]].point(), positions[tri[1]].point(), positions[tri[2]].point(),
+                            t_lo, t_hi, t, b0, b1, b2))
+                return true;
+        }
+        return false;
+    });
+}
+
+bool triangle_mesh::bounding_box(aabb &output_box) const {
+    output_box = mesh->bvh.bounds();
+    return !output_box.empty();
+}
+
+#endif
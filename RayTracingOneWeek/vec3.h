@@ -8,56 +8,63 @@
 
 using std::sqrt;
 
-class vec3 {
+// 三维向量，按标量类型T模板化。渲染器里的vec3使用real，定义RT_USE_FLOAT时就是float。
+// 运算符定义为友元，标量参数可以从double隐式转换过来
+template<typename T>
+class vec3_t {
 public:
-    vec3() : e{0, 0, 0} {}
+    vec3_t() : e{0, 0, 0} {}
 
-    vec3(double e0, double e1, double e2) : e{e0, e1, e2} {}
+    vec3_t(T e0, T e1, T e2) : e{e0, e1, e2} {}
 
-    double x() const { return e[0]; }
+    // 不同精度的向量之间显式转换
+    template<typename U>
+    explicit vec3_t(const vec3_t<U> &v) : e{static_cast<T>(v.e[0]), static_cast<T>(v.e[1]), static_cast<T>(v.e[2])} {}
 
-    double y() const { return e[1]; }
+    T x() const { return e[0]; }
 
-    double z() const { return e[2]; }
+    T y() const { return e[1]; }
 
-    vec3 operator-() const { return vec3(-e[0], -e[1], -e[2]); }
+    T z() const { return e[2]; }
 
-    double operator[](int i) const { return e[i]; }
+    vec3_t operator-() const { return vec3_t(-e[0], -e[1], -e[2]); }
 
-    double &operator[](int i) { return e[i]; }
+    T operator[](int i) const { return e[i]; }
 
-    vec3 &operator+=(const vec3 &v) {
+    T &operator[](int i) { return e[i]; }
+
+    vec3_t &operator+=(const vec3_t &v) {
         e[0] += v.e[0];
         e[1] += v.e[1];
         e[2] += v.e[2];
         return *this;
     }
 
-    vec3 &operator*=(const double t) {
+    vec3_t &operator*=(const T t) {
         e[0] *= t;
         e[1] *= t;
         e[2] *= t;
         return *this;
     }
 
-    vec3 &operator/=(const double t) {
+    vec3_t &operator/=(const T t) {
         return *this *= 1 / t;
     }
 
-    double length() const {
+    T length() const {
         return sqrt(length_squared());
     }
 
-    double length_squared() const {
+    T length_squared() const {
         return e[0] * e[0] + e[1] * e[1] + e[2] * e[2];
     }
 
-    inline static vec3 random() {
-        return vec3(random_double(), random_double(), random_double());
+    inline static vec3_t random() {
+        return vec3_t(random_double(), random_double(), random_double());
     }
 
-    inline static vec3 random(double min, double max) {
-        return vec3(random_double(min, max), random_double(min, max), random_double(min, max));
+    inline static vec3_t random(double min, double max) {
+        return vec3_t(random_double(min, max), random_double(min, max), random_double(min, max));
     }
 
     // 此时向量的各分量是否都接近0
@@ -67,60 +74,66 @@ public:
         return (fabs(e[0]) < s) && (fabs(e[1]) < s) && (fabs(e[2]) < s);
     }
 
-public:
-    double e[3];
-};
+    // vec3 Utility Functions
 
-// Type aliases for vec3
-using point3 = vec3;   // 3D point
-// 将x, y, z 映射到 r, g, b
-using color = vec3;    // RGB color
+    friend inline std::ostream &operator<<(std::ostream &out, const vec3_t &v) {
+        return out << v.e[0] << ' ' << v.e[1] << ' ' << v.e[2];
+    }
 
-// vec3 Utility Functions
+    friend inline vec3_t operator+(const vec3_t &u, const vec3_t &v) {
+        return vec3_t(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
+    }
 
-inline std::ostream &operator<<(std::ostream &out, const vec3 &v) {
-    return out << v.e[0] << ' ' << v.e[1] << ' ' << v.e[2];
-}
+    friend inline vec3_t operator-(const vec3_t &u, const vec3_t &v) {
+        return vec3_t(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
+    }
 
-inline vec3 operator+(const vec3 &u, const vec3 &v) {
-    return vec3(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
-}
+    friend inline vec3_t operator*(const vec3_t &u, const vec3_t &v) {
+        return vec3_t(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
+    }
 
-inline vec3 operator-(const vec3 &u, const vec3 &v) {
-    return vec3(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
-}
+    friend inline vec3_t operator*(T t, const vec3_t &v) {
+        return vec3_t(t * v.e[0], t * v.e[1], t * v.e[2]);
+    }
 
-inline vec3 operator*(const vec3 &u, const vec3 &v) {
-    return vec3(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
-}
+    friend inline vec3_t operator*(const vec3_t &v, T t) {
+        return t * v;
+    }
 
-inline vec3 operator*(double t, const vec3 &v) {
-    return vec3(t * v.e[0], t * v.e[1], t * v.e[2]);
-}
+    friend inline vec3_t operator/(vec3_t v, T t) {
+        return (1 / t) * v;
+    }
 
-inline vec3 operator*(const vec3 &v, double t) {
-    return t * v;
-}
+    friend inline T dot(const vec3_t &u, const vec3_t &v) {
+        return u.e[0] * v.e[0]
+               + u.e[1] * v.e[1]
+               + u.e[2] * v.e[2];
+    }
 
-inline vec3 operator/(vec3 v, double t) {
-    return (1 / t) * v;
-}
+    friend inline vec3_t cross(const vec3_t &u, const vec3_t &v) {
+        return vec3_t(u.e[1] * v.e[2] - u.e[2] * v.e[1],
+                      u.e[2] * v.e[0] - u.e[0] * v.e[2],
+                      u.e[0] * v.e[1] - u.e[1] * v.e[0]);
+    }
 
-inline double dot(const vec3 &u, const vec3 &v) {
-    return u.e[0] * v.e[0]
-           + u.e[1] * v.e[1]
-           + u.e[2] * v.e[2];
-}
+    // 单位向量
+    friend inline vec3_t unit_vector(vec3_t v) {
+        return v / v.length();
+    }
 
-inline vec3 cross(const vec3 &u, const vec3 &v) {
-    return vec3(u.e[1] * v.e[2] - u.e[2] * v.e[1],
-                u.e[2] * v.e[0] - u.e[0] * v.e[2],
-                u.e[0] * v.e[1] - u.e[1] * v.e[0]);
-}
+public:
+    T e[3];
+};
+
+// Type aliases for vec3
+typedef vec3_t<real> vec3;
+using point3 = vec3;   // 3D point
+// 将x, y, z 映射到 r, g, b
+using color = vec3;    // RGB color
 
-// 单位向量
-inline vec3 unit_vector(vec3 v) {
-    return v / v.length();
+// 各分量绝对值的最大值，用来估计浮点误差
+inline real max_abs(const vec3 &v) {
+    return std::fmax(std::fabs(v.x()), std::fmax(std::fabs(v.y()), std::fabs(v.z())));
 }
 
 // 知道取到符合条件的点为止
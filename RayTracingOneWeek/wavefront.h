@@ -0,0 +1,256 @@
+#pragma once
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include "rtweekend.h"
+#include "hittable.h"
+#include "material.h"
+#include "integrator.h"
+#include "sampler.h"
+#include "compiled_scene.h"
+#include "rt_stats.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// 波前(wavefront)路径追踪：一批路径按弹射次数同步推进，每次弹射分成几个阶段，每个阶段对整批路径执行同一段代码。
+//   1. 求交：存活的光线一起求交，主光线按光线包，之后逐条
+//   2. 分拣：没有击中的路径加上背景色结束，击中发光表面的加上它的光，击中的按材质种类分到各自的队列
+//   3. 着色：每种材质对自己的队列调用非虚的scatter，循环里只有这一种材质的代码，
+//      没有虚函数调用，分支预测和指令缓存都是稳定的；同时生成直接光照的阴影光线，随后做俄罗斯轮盘赌
+//   4. 阴影：这次弹射的阴影光线一起求交，没被挡住的加上光源的贡献
+//   5. 压缩：存活的路径写入下一次弹射的队列
+// 每条路径带着自己的采样器，取值的维度与path_integrator相同，所以两者的结果逐位一致。
+
+// 一批路径的状态，按分量分开存放(SoA)
+struct path_queue {
+    std::vector<real> origin_x, origin_y, origin_z;
+    std::vector<real> direction_x, direction_y, direction_z;
+    std::vector<real> time;
+    std::vector<real> throughput_r, throughput_g, throughput_b;
+    // 采样出这条光线的BSDF的pdf，与path_integrator中的bsdf_pdf相同
+    std::vector<double> bsdf_pdf;
+    std::vector<sampler> samplers;
+    // 路径在这一批中的序号，结果写到radiance[path]
+    std::vector<uint32_t> path;
+
+    size_t size() const { return path.size(); }
+
+    ray ray_at(size_t k) const {
+        return ray(point3(origin_x[k], origin_y[k], origin_z[k]),
+                   vec3(direction_x[k], direction_y[k], direction_z[k]), time[k]);
+    }
+
+    color throughput(size_t k) const {
+        return color(throughput_r[k], throughput_g[k], throughput_b[k]);
+    }
+
+    // 清空但保留容量，之后的批次不再分配内存
+    void clear();
+
+    void push(const ray &r, const color &throughput, double pdf, const sampler &smp, uint32_t index);
+};
+
+void path_queue::clear() {
+    for (std::vector<real> *v : {&origin_x, &origin_y, &origin_z, &direction_x, &direction_y, &direction_z, &time,
+                                 &throughput_r, &throughput_g, &throughput_b})
+        v->clear();
+    bsdf_pdf.clear();
+    samplers.clear();
+    path.clear();
+}
+
+void path_queue::push(const ray &r, const color &throughput, double pdf, const sampler &smp, uint32_t index) {
+    origin_x.push_back(r.origin().x());
+    origin_y.push_back(r.origin().y());
+    origin_z.push_back(r.origin().z());
+    direction_x.push_back(r.direction().x());
+    direction_y.push_back(r.direction().y());
+    direction_z.push_back(r.direction().z());
+    time.push_back(r.time());
+    throughput_r.push_back(throughput.x());
+    throughput_g.push_back(throughput.y());
+    throughput_b.push_back(throughput.z());
+    bsdf_pdf.push_back(pdf);
+    samplers.push_back(smp);
+    path.push_back(index);
+}
+
+// 一次弹射中生成的阴影光线：光线、求交的上限、没被挡住时加到radiance[path]的颜色
+struct shadow_queue {
+    std::vector<ray> rays;
+    std::vector<real> t_max;
+    std::vector<color> contribution;
+    std::vector<uint32_t> path;
+
+    void clear() {
+        rays.clear();
+        t_max.clear();
+        contribution.clear();
+        path.clear();
+    }
+
+    void push(const ray &r, real t, const color &c, uint32_t index) {
+        rays.push_back(r);
+        t_max.push_back(t);
+        contribution.push_back(c);
+        path.push_back(index);
+    }
+};
+
+// 各阶段之间传递数据的缓冲区，每个渲染线程一份，反复使用
+struct wavefront_buffers {
+    path_queue queues[2];
+    shadow_queue shadows;
+    std::vector<hit_record> recs;
+    std::vector<unsigned char> hits;
+    // 按material_kind分拣的撞点，保存在当前队列中的下标
+    std::vector<uint32_t> bins[4];
+};
+
+inline wavefront_buffers &thread_wavefront_buffers() {
+    thread_local wavefront_buffers buffers;
+    return buffers;
+}
+
+class wavefront_integrator {
+public:
+    wavefront_integrator() {}
+
+    wavefront_integrator(int max_depth, int rr_depth) : max_depth(max_depth), rr_depth(rr_depth) {}
+
+    // 追踪n条从primary[k]开始的路径，samplers[k]是生成这条主光线的采样器，结果写到radiance[k]
+    void trace(const ray *primary, const sampler *samplers, int n, const compiled_scene &world, color *radiance) const;
+
+public:
+    // 与path_integrator的含义相同
+    int max_depth = 50;
+    int rr_depth = 5;
+
+private:
+    // 着色阶段：对一个材质队列里的撞点做直接光照和scatter，M是队列的材质类型。
+    // 阴影光线写入shadows，存活的路径写入next
+    template<typename M>
+    void shade(const path_queue &current, const std::vector<uint32_t> &bin, const hit_record *recs, int depth,
+               const compiled_scene &world, shadow_queue &shadows, path_queue &next) const;
+};
+
+void wavefront_integrator::trace(const ray *primary, const sampler *samplers, int n, const compiled_scene &world,
+                                 color *radiance) const {
+    for (int k = 0; k < n; ++k)
+        radiance[k] = color(0, 0, 0);
+    if (max_depth <= 0)
+        return;
+
+    wavefront_buffers &b = thread_wavefront_buffers();
+    path_queue *current = &b.queues[0], *next = &b.queues[1];
+    current->clear();
+    for (int k = 0; k < n; ++k)
+        current->push(primary[k], color(1, 1, 1), 0, samplers[k], static_cast<uint32_t>(k));
+
+    for (int depth = 1; current->size() > 0; ++depth) {
+        size_t count = current->size();
+        b.recs.resize(count);
+        b.hits.resize(count);
+
+        // 求交
+        RT_STAT_RAYS(depth - 1, count);
+        if (depth == 1) {
+            // 主光线按生成的顺序相邻，同一像素的采样彼此相干
+            ray rays[ray_packet_size];
+            bool hits[ray_packet_size];
+            for (size_t s0 = 0; s0 < count; s0 += ray_packet_size) {
+                int m = static_cast<int>(std::min<size_t>(ray_packet_size, count - s0));
+                for (int k = 0; k < m; ++k)
+                    rays[k] = current->ray_at(s0 + k);
+                world.hit_packet(rays, m, 0, infinity, &b.recs[s0], hits);
+                for (int k = 0; k < m; ++k)
+                    b.hits[s0 + k] = hits[k];
+            }
+        } else {
+            for (size_t k = 0; k < count; ++k)
+                b.hits[k] = world.hit(current->ray_at(k), 0, infinity, b.recs[k]);
+        }
+
+        // 分拣：没有击中的路径在这里结束，击中的按材质分组
+        for (std::vector<uint32_t> &bin : b.bins)
+            bin.clear();
+        for (size_t k = 0; k < count; ++k) {
+            if (!b.hits[k]) {
+                radiance[current->path[k]] += current->throughput(k) * world.background.at(current->ray_at(k));
+                continue;
+            }
+            if (b.recs[k].mat_ptr->kind == material_kind::other)
+                radiance[current->path[k]] += current->throughput(k) *
+                                              emitted_light(world, current->ray_at(k), b.recs[k], current->bsdf_pdf[k]);
+            if (depth >= max_depth) {
+                // 已经到达弹射次数上限，散射出去的光线不会再贡献颜色
+                RT_STAT_ADD(paths_max_depth, 1);
+            } else {
+                b.bins[static_cast<int>(b.recs[k].mat_ptr->kind)].push_back(static_cast<uint32_t>(k));
+            }
+        }
+
+        // 着色：限定名调用让编译器直接内联每种材质的scatter
+        next->clear();
+        b.shadows.clear();
+        const hit_record *recs = b.recs.data();
+        shade<lambertian>(*current, b.bins[static_cast<int>(material_kind::lambertian)], recs, depth, world,
+                          b.shadows, *next);
+        shade<metal>(*current, b.bins[static_cast<int>(material_kind::metal)], recs, depth, world, b.shadows, *next);
+        shade<dielectric>(*current, b.bins[static_cast<int>(material_kind::dielectric)], recs, depth, world,
+                          b.shadows, *next);
+        shade<material>(*current, b.bins[static_cast<int>(material_kind::other)], recs, depth, world, b.shadows, *next);
+
+        // 阴影
+        for (size_t k = 0; k < b.shadows.path.size(); ++k)
+            if (unoccluded(world, b.shadows.rays[k], b.shadows.t_max[k]))
+                radiance[b.shadows.path[k]] += b.shadows.contribution[k];
+
+        std::swap(current, next);
+    }
+}
+
+template<typename M>
+void wavefront_integrator::shade(const path_queue &current, const std::vector<uint32_t> &bin, const hit_record *recs,
+                                 int depth, const compiled_scene &world, shadow_queue &shadows,
+                                 path_queue &next) const {
+    for (uint32_t k : bin) {
+        sampler smp = current.samplers[k];
+        ray r_in = current.ray_at(k);
+        color throughput = current.throughput(k);
+
+        ray shadow;
+        real shadow_t;
+        color contribution;
+        if (light_sample_ray<M>(world, r_in, recs[k], smp, depth, shadow, shadow_t, contribution))
+            shadows.push(shadow, shadow_t, throughput * contribution, current.path[k]);
+
+        smp.set_dimension(bounce_dimension(depth));
+        ray scattered;
+        color attenuation;
+        if (!material_calls<M>::scatter(r_in, recs[k], attenuation, scattered, smp)) {
+            RT_STAT_ADD(paths_absorbed, 1);
+            continue;
+        }
+        double pdf = material_calls<M>::pdf(r_in, recs[k], scattered.direction());
+        throughput = throughput * attenuation;
+
+        // 俄罗斯轮盘赌，与path_integrator相同
+        if (rr_depth > 0 && depth >= rr_depth) {
+            double max_component = std::max(throughput.x(), std::max(throughput.y(), throughput.z()));
+            double q = std::max(0.05, 1.0 - max_component);
+            smp.set_dimension(roulette_dimension(depth));
+            if (smp.get_1d() < q) {
+                RT_STAT_ADD(paths_roulette, 1);
+                continue;
+            }
+            throughput /= 1.0 - q;
+        }
+        next.push(scattered, throughput, pdf, smp, current.path[k]);
+    }
+}
+
+#endif